@@ -1,27 +1,88 @@
 // (c) XenFFly
 
 #include "BehAnim.h"
+#include "Animation/AnimInstance.h"
+#include "Animation/AnimMontage.h"
+#include "Components/SkeletalMeshComponent.h"
 #include "GameFramework/Character.h"
 
+UBehAnim::UBehAnim(const FObjectInitializer& ObjectInitializer)
+	: Super(ObjectInitializer)
+{
+	bTickOnDemand = true;
+}
+
+FBehaviorRequest UBehAnim::MakeRequest(UAnimSequenceBase* Animation, bool bLooping, bool bResetPose)
+{
+	FBehAnimParams Params;
+	Params.Animation = Animation;
+	Params.bLooping = bLooping;
+	Params.bResetPose = bResetPose;
+	return FBehaviorRequest(StaticClass(), Params);
+}
+
+FBehaviorRequest UBehAnim::MakeSlotRequest(UAnimSequenceBase* Animation, FName SlotName, float PlayRate, bool bLooping)
+{
+	FBehAnimParams Params;
+	Params.Animation = Animation;
+	Params.bLooping = bLooping;
+	Params.SlotName = SlotName;
+	Params.PlayRate = PlayRate;
+	return FBehaviorRequest(StaticClass(), Params);
+}
+
+void UBehAnim::ApplyRequest(const FBehaviorRequest& Request)
+{
+	if (const FBehAnimParams* Params = Request.GetPayload<FBehAnimParams>())
+	{
+		Animation = Params->Animation.Get();
+		bLooping = Params->bLooping;
+		bResetPose = Params->bResetPose;
+		SlotName = Params->SlotName;
+		PlayRate = Params->PlayRate;
+	}
+}
+
 void UBehAnim::Activate()
 {
 	Super::Activate();
 
+	// Pooled instances keep these from the last run.
+	bPlayed = false;
+	bSingleNode = false;
+	PlayingMontage = nullptr;
+
 	if (!Animation)
 	{
-		FinishBehavior(BR_Failed, "AnimNotSelected");
+		FinishBehavior(BR_Failed, BehaviorCodes::AnimNotSelected);
 		return;
 	}
 
-	AI = Cast<ACharacter>(GetAIController()->GetPawn());
+	AAIController* Controller = GetAIController();
+	AI = IsValid(Controller) ? Cast<ACharacter>(Controller->GetPawn()) : nullptr;
 
 	if (!IsValid(AI))
 	{
-		FinishBehavior(BR_Failed, "FindAI_Invalid");
+		FinishBehavior(BR_Failed, BehaviorCodes::FindAIInvalid);
 		return;
 	}
 
+	// Slots need the Animation Blueprint, other meshes play in single node mode.
+	USkeletalMeshComponent* Mesh = AI->GetMesh();
+	if (SlotName.IsNone() || Mesh->GetAnimationMode() != EAnimationMode::AnimationBlueprint || !Mesh->GetAnimInstance())
+	{
+		PlaySingleNode();
+		return;
+	}
+
+	PlayMontage();
+}
+
+void UBehAnim::PlaySingleNode()
+{
+	bSingleNode = true;
 	AI->GetMesh()->PlayAnimation(Animation, bLooping);
+	AI->GetMesh()->SetPlayRate(PlayRate);
 
 	if (!bLooping)
 	{
@@ -29,27 +90,85 @@ void UBehAnim::Activate()
 		BehDelay(TimerHandle, [=](){
 			if (!IsValid(AI))
 				return;
-			
+
 			if (bResetPose)
 				AI->GetMesh()->SetAnimationMode(EAnimationMode::AnimationBlueprint);
-			
+
 			bPlayed = true;
 			OnAnimationFinished.Broadcast(Animation, bPlayed);
 
 			if (!bIsFinishing)
 				FinishBehavior(BR_Success);
-		}, Animation->GetPlayLength());
+		}, GetScaledPlayLength());
+	}
+}
+
+void UBehAnim::PlayMontage()
+{
+	// A looping montage repeats its segment until it's stopped.
+	const int32 LoopCount = bLooping ? MAX_int32 : 1;
+	UAnimInstance* AnimInstance = AI->GetMesh()->GetAnimInstance();
+	UAnimMontage* Montage = AnimInstance ? AnimInstance->PlaySlotAnimationAsDynamicMontage(Animation, SlotName, BlendTime, BlendTime, PlayRate, LoopCount) : nullptr;
+	if (!Montage)
+	{
+		FinishBehavior(BR_Failed, BehaviorCodes::AnimNotSelected);
+		return;
+	}
+
+	PlayingMontage = Montage;
+
+	// Blending out starts at the end of the montage, when it's stopped or replaced by another montage in the slot.
+	FOnMontageBlendingOutStarted BlendingOutDelegate = FOnMontageBlendingOutStarted::CreateUObject(this, &UBehAnim::OnMontageBlendingOut);
+	AnimInstance->Montage_SetBlendingOutDelegate(BlendingOutDelegate, Montage);
+}
+
+void UBehAnim::OnMontageBlendingOut(UAnimMontage* Montage, bool bInterrupted)
+{
+	// Each play creates a new montage, so a montage of an earlier run can't finish a pooled BehAnim.
+	if (Montage != PlayingMontage || !IsBehaviorValid())
+		return;
+
+	PlayingMontage = nullptr;
+	if (bIsFinishing)
+		return;
+
+	if (bInterrupted)
+	{
+		FinishBehavior(BR_Failed, BehaviorCodes::Aborted);
+		return;
 	}
+
+	bPlayed = true;
+	OnAnimationFinished.Broadcast(Animation, bPlayed);
+	FinishBehavior(BR_Success);
 }
 
-void UBehAnim::OnBehaviorFinished_Implementation(EBehaviorResult Result, const FString& FailedCode)
+float UBehAnim::GetScaledPlayLength() const
 {
-	Super::OnBehaviorFinished_Implementation(Result, FailedCode);
-	
-	if (bResetPose && IsValid(AI))
+	float Rate = PlayRate * Animation->RateScale;
+	if (IsValid(AI))
+		Rate *= AI->GetMesh()->GlobalAnimRateScale * AI->CustomTimeDilation;
+
+	// Timers already run in dilated world time.
+	return Animation->GetPlayLength() / FMath::Max(FMath::Abs(Rate), KINDA_SMALL_NUMBER);
+}
+
+void UBehAnim::OnBehaviorFinishedName_Implementation(EBehaviorResult Result, FName FailedCode)
+{
+	Super::OnBehaviorFinishedName_Implementation(Result, FailedCode);
+
+	if (PlayingMontage)
+	{
+		UAnimMontage* Montage = PlayingMontage;
+		PlayingMontage = nullptr;
+		UAnimInstance* AnimInstance = IsValid(AI) ? AI->GetMesh()->GetAnimInstance() : nullptr;
+		if (AnimInstance)
+			AnimInstance->Montage_Stop(BlendTime, Montage);
+	}
+
+	if (bResetPose && bSingleNode && IsValid(AI))
 		AI->GetMesh()->SetAnimationMode(EAnimationMode::AnimationBlueprint);
 
 	if (IsBehaviorValid() && !bPlayed)
 		OnAnimationFinished.Broadcast(Animation, bPlayed);
 }
-
@@ -6,25 +6,80 @@
 #include "Behavior.h"
 #include "BehAnim.generated.h"
 
+class UAnimMontage;
+
 DECLARE_DYNAMIC_MULTICAST_DELEGATE_TwoParams(FOnAnimationFinished, UAnimSequenceBase*, Animation, bool, bFullPlayed);
 
+// FBehaviorRequest payload of UBehAnim.
+USTRUCT()
+struct FBehAnimParams
+{
+	GENERATED_BODY()
+
+	UPROPERTY()
+	TWeakObjectPtr<UAnimSequenceBase> Animation;
+
+	UPROPERTY()
+	bool bLooping = false;
+
+	UPROPERTY()
+	bool bResetPose = true;
+
+	// None - the mesh plays Animation in single node mode.
+	UPROPERTY()
+	FName SlotName;
+
+	UPROPERTY()
+	float PlayRate = 1.f;
+};
+
+/**
+ * Plays Animation on the Character of the AI.
+ * With a SlotName the Animation is played as a dynamic montage on the existing AnimInstance (no animation mode switch)
+ * and the Behavior finishes when the montage blends out. Without it the mesh switches to single node mode
+ * and the Behavior finishes after the play length, scaled by the play rate.
+ */
 UCLASS()
 class SHATALOVBEHAVIOR_API UBehAnim : public UBehavior
 {
 	GENERATED_BODY()
 
 public:
+	UBehAnim(const FObjectInitializer& ObjectInitializer);
+
 	virtual void Activate() override;
-	virtual void OnBehaviorFinished_Implementation(EBehaviorResult Result, const FString& FailedCode) override;
+	virtual void ApplyRequest(const FBehaviorRequest& Request) override;
+
+	static FBehaviorRequest MakeRequest(UAnimSequenceBase* Animation, bool bLooping, bool bResetPose);
+	static FBehaviorRequest MakeSlotRequest(UAnimSequenceBase* Animation, FName SlotName, float PlayRate, bool bLooping);
+	virtual void OnBehaviorFinishedName_Implementation(EBehaviorResult Result, FName FailedCode) override;
 
 	UPROPERTY(BlueprintAssignable)
 		FOnAnimationFinished OnAnimationFinished;
-	
+
 	UAnimSequenceBase* Animation;
 	bool bLooping;
 	bool bResetPose;
+	FName SlotName;
+	float PlayRate = 1.f;
+
+	// Blend in/out time of slot animations.
+	UPROPERTY(EditDefaultsOnly, BlueprintReadWrite, Category = Animation)
+	float BlendTime = 0.25f;
 
 private:
+	void PlaySingleNode();
+	void PlayMontage();
+	void OnMontageBlendingOut(UAnimMontage* Montage, bool bInterrupted);
+
+	// Play length in game time, with the play rates of the asset, the mesh and the actor.
+	float GetScaledPlayLength() const;
+
 	class ACharacter* AI;
 	bool bPlayed;
+
+	UPROPERTY()
+	UAnimMontage* PlayingMontage;
+
+	bool bSingleNode = false;
 };
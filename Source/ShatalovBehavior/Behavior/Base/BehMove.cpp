@@ -1,11 +1,33 @@
 // (c) XenFFly
 
 #include "BehMove.h"
-#include "Tasks/AITask_MoveTo.h"
+#include "Behavior/BehaviorPathService.h"
+#include "Behavior/BehaviorSubsystem.h"
+#include "NavigationData.h"
+#include "NavigationSystem.h"
+#include "Navigation/PathFollowingComponent.h"
 
 UBehMove::UBehMove(const FObjectInitializer& ObjectInitializer)
-	: Super(ObjectInitializer), MoveTask(nullptr)
+	: Super(ObjectInitializer)
 {
+	bTickOnDemand = true;
+}
+
+FBehaviorRequest UBehMove::MakeRequest(const FVector& TargetLocation, float AcceptanceRadius)
+{
+	FBehMoveParams Params;
+	Params.TargetLocation = TargetLocation;
+	Params.AcceptanceRadius = AcceptanceRadius;
+	return FBehaviorRequest(StaticClass(), Params);
+}
+
+void UBehMove::ApplyRequest(const FBehaviorRequest& Request)
+{
+	if (const FBehMoveParams* Params = Request.GetPayload<FBehMoveParams>())
+	{
+		TargetLocation = Params->TargetLocation;
+		AcceptanceRadius = Params->AcceptanceRadius;
+	}
 }
 
 void UBehMove::Activate()
@@ -15,71 +37,202 @@ void UBehMove::Activate()
 	if (!IsValid(GetAIController()))
 	{
 		UE_LOG(LogBehavior, Error, TEXT("BehMove: Can't use task without APawn & AIController"));
-		FinishBehavior(BR_Failed, "AIController_Error");
+		FinishBehavior(BR_Failed, BehaviorCodes::AIControllerError);
 		return;
 	}
 
 	if (IsValid(GetParentBehavior()) && GetParentBehavior()->IsA(StaticClass()))
 	{
 		UE_LOG(LogBehavior, Error, TEXT("BehMove was called as a child task of BehMove."));
-		FinishBehavior(BR_Failed, "RepeatBehMove");
+		FinishBehavior(BR_Failed, BehaviorCodes::RepeatBehMove);
 		return;
 	}
 
-	GetAIController()->ReceiveMoveCompleted.AddDynamic(this, &UBehMove::OnMoveFinished);
-
-	MoveTask = UAITask_MoveTo::AIMoveTo(
-	   GetAIController(),
-	   TargetLocation,
-	   nullptr,
-	   AcceptanceRadius,
-	   EAIOptionFlag::Default, // StopOnOverlap
-	   EAIOptionFlag::Disable, // AcceptPartialPath
-	   true // bUsePathfinding
-   );
-	MoveTask->ReadyForActivation();
+	StartMove();
+}
+
+void UBehMove::StartMove()
+{
+	AAIController* Controller = GetAIController();
+	MakeMoveRequest();
+
+	// Shared path cache, identical paths are found once.
+	if (UBehaviorPathService* PathService = GetPathService())
+	{
+		FNavPathSharedPtr CachedPath;
+		const uint32 Ticket = PathService->RequestPath(this, Controller, TargetLocation, Controller->GetDefaultNavigationFilterClass(), CachedPath);
+		if (Ticket != 0)
+		{
+			PathTicket = Ticket;
+			if (CachedPath.IsValid())
+				OnPathFound(Ticket, CachedPath);
+			return;
+		}
+	}
+
+	// The service can't use navigation here, the controller finds the path.
+	const FPathFollowingRequestResult Result = Controller->MoveTo(MoveRequest);
+	switch (Result.Code)
+	{
+	case EPathFollowingRequestResult::RequestSuccessful:
+		WatchMove(Result.MoveId);
+		break;
+	case EPathFollowingRequestResult::AlreadyAtGoal:
+		// Finished inside MoveTo, before we could watch it.
+		MoveRequestID = Result.MoveId;
+		OnMoveFinished(Result.MoveId, EPathFollowingResult::Success);
+		break;
+	default:
+		MoveRequestID = Result.MoveId;
+		OnMoveFinished(Result.MoveId, EPathFollowingResult::Invalid);
+		break;
+	}
+}
+
+void UBehMove::MakeMoveRequest()
+{
+	MoveRequest = FAIMoveRequest(TargetLocation);
+	MoveRequest.SetAcceptanceRadius(AcceptanceRadius);
+	MoveRequest.SetUsePathfinding(true);
+	MoveRequest.SetAllowPartialPath(false);
+}
+
+void UBehMove::SetTargetLocation(FVector NewTargetLocation, float NewAcceptanceRadius)
+{
+	TargetLocation = NewTargetLocation;
+	AcceptanceRadius = NewAcceptanceRadius;
+
+	// Not started yet: Activate will use it.
+	if (!IsBehaviorValid() || !IsActive() || !IsValid(GetAIController()))
+		return;
+
+	// A new move replaces ours in the path following, its abort must not finish us.
+	PathTicket = 0;
+	UnwatchMove();
+	StartMove();
 }
 
-void UBehMove::OnBehaviorFinished_Implementation(EBehaviorResult Result, const FString& FailedCode)
+void UBehMove::OnBehaviorFinishedName_Implementation(EBehaviorResult Result, FName FailedCode)
 {
-	Super::OnBehaviorFinished_Implementation(Result, FailedCode);
-
-	// Unbind the delegate to avoid double subscription in the future.
-	if (IsValid(GetAIController()))
-		GetAIController()->ReceiveMoveCompleted.RemoveDynamic(this, &UBehMove::OnMoveFinished);
-	
-	// Stop movement
-	if (IsValid(MoveTask))
+	Super::OnBehaviorFinishedName_Implementation(Result, FailedCode);
+
+	PathTicket = 0;
+	UnwatchMove();
+
+	// Stop movement, if the move is still ours.
+	if (MoveRequestID.IsValid() && IsValid(GetAIController()))
 	{
-		GEngine->AddOnScreenDebugMessage(-1, 5.f, FColor::Red, TEXT("BehMove::OnBehaviorFinished_Implementation()"));
-		MoveTask->EndTask();
+		UPathFollowingComponent* PathFollowing = GetAIController()->GetPathFollowingComponent();
+		if (PathFollowing && PathFollowing->GetCurrentRequestId() == MoveRequestID)
+			PathFollowing->AbortMove(*this, FPathFollowingResultFlags::OwnerFinished, MoveRequestID);
 	}
+	MoveRequestID = FAIRequestID::InvalidRequest;
+}
+
+void UBehMove::OnPathFound(uint32 Ticket, FNavPathSharedPtr Path)
+{
+	if (Ticket != PathTicket || !IsBehaviorValid())
+		return;
+
+	PathTicket = 0;
+	AAIController* Controller = GetAIController();
+	if (!Path.IsValid() || Path->GetPathPoints().Num() == 0 || !IsValid(Controller))
+	{
+		FinishBehavior(BR_Failed, BehaviorCodes::Invalid);
+		return;
+	}
+
+	// The path is shared, follow a copy starting at our location (the same poly as the cached start)
+	// and ending at our target (the same goal cell as the cached goal) if it's on the last poly of the path.
+	FNavPathSharedRef AgentPath = MakeShared<FNavigationPath, ESPMode::ThreadSafe>();
+	AgentPath->GetPathPoints() = Path->GetPathPoints();
+	AgentPath->GetPathPoints()[0].Location = Controller->GetNavAgentLocation();
+
+	FNavPathPoint& EndPoint = AgentPath->GetPathPoints().Last();
+	UNavigationSystemV1* NavSys = FNavigationSystem::GetCurrent<UNavigationSystemV1>(GetWorld());
+	FNavLocation ProjectedTarget;
+	if (NavSys && NavSys->ProjectPointToNavigation(TargetLocation, ProjectedTarget, INVALID_NAVEXTENT, Path->GetNavigationDataUsed(), Path->GetFilter()) &&
+		ProjectedTarget.NodeRef == EndPoint.NodeRef)
+		EndPoint.Location = ProjectedTarget.Location;
+	AgentPath->SetNavigationDataUsed(Path->GetNavigationDataUsed());
+	AgentPath->SetFilter(Path->GetFilter());
+	AgentPath->SetQuerier(Controller);
+	AgentPath->MarkReady();
+
+	// Repath when the navmesh changes, like paths found by MoveTo.
+	AgentPath->EnableRecalculationOnInvalidation(true);
+	if (ANavigationData* NavData = AgentPath->GetNavigationDataUsed())
+		NavData->RegisterActivePath(AgentPath);
+
+	const FAIRequestID RequestID = Controller->RequestMove(MoveRequest, AgentPath);
+	if (RequestID.IsValid())
+		WatchMove(RequestID);
+	else FinishBehavior(BR_Failed, BehaviorCodes::Invalid);
+}
+
+void UBehMove::WatchMove(FAIRequestID RequestID)
+{
+	MoveRequestID = RequestID;
+	if (UBehaviorPathService* PathService = GetPathService())
+		PathService->RegisterMove(this, GetAIController(), RequestID);
+	else if (UPathFollowingComponent* PathFollowing = GetAIController()->GetPathFollowingComponent())
+	{
+		if (!RequestFinishedHandle.IsValid())
+			RequestFinishedHandle = PathFollowing->OnRequestFinished.AddUObject(this, &UBehMove::OnRequestFinished);
+	}
+}
+
+void UBehMove::UnwatchMove()
+{
+	if (UBehaviorPathService* PathService = GetPathService())
+		PathService->UnregisterMove(MoveRequestID);
+
+	if (RequestFinishedHandle.IsValid())
+	{
+		if (UPathFollowingComponent* PathFollowing = IsValid(GetAIController()) ? GetAIController()->GetPathFollowingComponent() : nullptr)
+			PathFollowing->OnRequestFinished.Remove(RequestFinishedHandle);
+		RequestFinishedHandle.Reset();
+	}
+}
+
+void UBehMove::OnRequestFinished(FAIRequestID RequestID, const FPathFollowingResult& Result)
+{
+	OnMoveFinished(RequestID, Result.Code);
+}
+
+UBehaviorPathService* UBehMove::GetPathService() const
+{
+	return GetBehaviorSubsystem() ? GetBehaviorSubsystem()->GetPathService() : nullptr;
 }
 
 void UBehMove::OnMoveFinished(FAIRequestID RequestID, EPathFollowingResult::Type Result)
 {
-	if (!IsBehaviorValid())
+	// A completion of an earlier move can't finish this one.
+	if (!IsBehaviorValid() || RequestID != MoveRequestID)
 		return;
-		
+
+	UnwatchMove();
+	MoveRequestID = FAIRequestID::InvalidRequest;
+
 	switch (Result)
 	{
 	case EPathFollowingResult::Success:
 		FinishBehavior(BR_Success);
 		break;
 	case EPathFollowingResult::Blocked:
-		FinishBehavior(BR_Failed, "Blocked");
+		FinishBehavior(BR_Failed, BehaviorCodes::Blocked);
 		break;
 	case EPathFollowingResult::OffPath:
-		FinishBehavior(BR_Failed, "OffPath");
+		FinishBehavior(BR_Failed, BehaviorCodes::OffPath);
 		break;
 	case EPathFollowingResult::Aborted:
-		FinishBehavior(BR_Failed, "Aborted");
+		FinishBehavior(BR_Failed, BehaviorCodes::Aborted);
 		break;
 	case EPathFollowingResult::Invalid:
-		FinishBehavior(BR_Failed, "Invalid");
+		FinishBehavior(BR_Failed, BehaviorCodes::Invalid);
 		break;
 	}
 
 	if (GetParentBehavior())
 		GetParentBehavior()->OnMoveCompleted(Result);
-}
\ No newline at end of file
+}
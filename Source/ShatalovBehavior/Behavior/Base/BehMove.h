@@ -6,6 +6,19 @@
 #include "Behavior.h"
 #include "BehMove.generated.h"
 
+// FBehaviorRequest payload of UBehMove.
+USTRUCT()
+struct FBehMoveParams
+{
+	GENERATED_BODY()
+
+	UPROPERTY()
+	FVector TargetLocation = FVector::ZeroVector;
+
+	UPROPERTY()
+	float AcceptanceRadius = 50.f;
+};
+
 UCLASS()
 class SHATALOVBEHAVIOR_API UBehMove : public UBehavior
 {
@@ -15,18 +28,47 @@ public:
 	UBehMove(const FObjectInitializer& ObjectInitializer);
 	
 	void Activate() override;
+	virtual void ApplyRequest(const FBehaviorRequest& Request) override;
 
-	virtual void OnBehaviorFinished_Implementation(EBehaviorResult Result, const FString& FailedCode) override;
+	static FBehaviorRequest MakeRequest(const FVector& TargetLocation, float AcceptanceRadius);
 
-	UFUNCTION()
-		void OnMoveFinished(FAIRequestID RequestID, EPathFollowingResult::Type Result);
+	virtual void OnBehaviorFinishedName_Implementation(EBehaviorResult Result, FName FailedCode) override;
+
+	/**
+	 * Move to a new location without restarting the Behavior (chasing). The current move continues until the new path is found.
+	 * RunBehMove calls it when the child is a running BehMove.
+	 */
+	UFUNCTION(BlueprintCallable, Category = Behavior)
+	void SetTargetLocation(FVector NewTargetLocation, float NewAcceptanceRadius);
+
+	// Completion of MoveRequestID, routed by UBehaviorPathService. Completions of other requests are ignored.
+	void OnMoveFinished(FAIRequestID RequestID, EPathFollowingResult::Type Result);
+
+	// Called by UBehaviorPathService, Path is null if it wasn't found.
+	void OnPathFound(uint32 Ticket, FNavPathSharedPtr Path);
 public:
 	FVector TargetLocation;
 	float AcceptanceRadius = 50.f;
 
+	// Request of UBehaviorPathService we wait for (0 - none).
+	uint32 PathTicket = 0;
+	// Path following request of the current move.
+	FAIRequestID MoveRequestID;
+
 	UPROPERTY()
 	FAIMoveRequest MoveRequest;
 
-	UPROPERTY()
-	class UAITask_MoveTo* MoveTask;
+private:
+	void StartMove();
+	void MakeMoveRequest();
+
+	// Route the completion of RequestID to OnMoveFinished.
+	void WatchMove(FAIRequestID RequestID);
+	void UnwatchMove();
+
+	// Without UBehaviorSubsystem (no path service) we bind the path following ourselves.
+	void OnRequestFinished(FAIRequestID RequestID, const FPathFollowingResult& Result);
+	FDelegateHandle RequestFinishedHandle;
+
+	class UBehaviorPathService* GetPathService() const;
 };
@@ -2,6 +2,12 @@
 
 #include "BehWait.h"
 
+UBehWait::UBehWait(const FObjectInitializer& ObjectInitializer)
+	: Super(ObjectInitializer)
+{
+	bTickOnDemand = true;
+}
+
 void UBehWait::Activate()
 {
 	Super::Activate();
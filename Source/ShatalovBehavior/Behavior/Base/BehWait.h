@@ -12,6 +12,7 @@ class SHATALOVBEHAVIOR_API UBehWait : public UBehavior
 	GENERATED_BODY()
 
 public:
+	UBehWait(const FObjectInitializer& ObjectInitializer);
 
 	virtual void Activate() override;
 
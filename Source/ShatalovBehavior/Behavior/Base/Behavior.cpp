@@ -4,32 +4,162 @@
 
 #include "BehAnim.h"
 #include "BehMove.h"
+#include "BehaviorSet.h"
+#include "Behavior/BehaviorClassLoader.h"
+#include "Behavior/BehaviorPool.h"
+#include "Behavior/BehaviorStats.h"
+#include "Behavior/BehaviorSubsystem.h"
 #include "GameplayTasksComponent.h"
-#include "Kismet/KismetMathLibrary.h"
 
 DEFINE_LOG_CATEGORY(LogBehavior);
 
+namespace BehaviorCodes
+{
+	const FName OverrideTask(TEXT("OverrideTask"));
+	const FName BehAbort(TEXT("BehAbort"));
+	const FName BaseZeroWeight(TEXT("BehBase_Failed_Weight=ZERO"));
+	const FName AIControllerError(TEXT("AIController_Error"));
+	const FName RepeatBehMove(TEXT("RepeatBehMove"));
+	const FName Blocked(TEXT("Blocked"));
+	const FName OffPath(TEXT("OffPath"));
+	const FName Aborted(TEXT("Aborted"));
+	const FName Invalid(TEXT("Invalid"));
+	const FName AnimNotSelected(TEXT("AnimNotSelected"));
+	const FName FindAIInvalid(TEXT("FindAI_Invalid"));
+}
+
+FBehaviorQueueEntry::FBehaviorQueueEntry(UBehavior* InBehavior)
+	: Request(InBehavior->GetClass()), Behavior(InBehavior), Type(InBehavior->Type), Priority(InBehavior->Priority)
+{
+}
+
+FBehaviorQueueEntry::FBehaviorQueueEntry(const FBehaviorRequest& InRequest)
+	: Request(InRequest), Type(InRequest.Class.GetDefaultObject()->Type), Priority(InRequest.Class.GetDefaultObject()->Priority)
+{
+}
+
+static void IncLiveBehaviorStat(EBehaviorType Type)
+{
+	switch (Type)
+	{
+	case BT_Default:	INC_DWORD_STAT(STAT_BehaviorNumDefault); break;
+	case BT_Parallel:	INC_DWORD_STAT(STAT_BehaviorNumParallel); break;
+	case BT_Base:		INC_DWORD_STAT(STAT_BehaviorNumBase); break;
+	}
+}
+
+static void DecLiveBehaviorStat(EBehaviorType Type)
+{
+	switch (Type)
+	{
+	case BT_Default:	DEC_DWORD_STAT(STAT_BehaviorNumDefault); break;
+	case BT_Parallel:	DEC_DWORD_STAT(STAT_BehaviorNumParallel); break;
+	case BT_Base:		DEC_DWORD_STAT(STAT_BehaviorNumBase); break;
+	}
+}
+
 UBehavior::UBehavior(const FObjectInitializer& ObjectInitializer)
-	: Super(ObjectInitializer), TaskQueue(nullptr), bIsInterrupted(false), bSelectingTask(false)
+	: Super(ObjectInitializer), bIsInterrupted(false), bSelectingTask(false),
+	ParentBehavior(nullptr), ActiveChild(nullptr), RootBehavior(nullptr), LastBehavior(nullptr), InterruptRoot(nullptr)
 {
-	bTickingTask = true;
+	// Ticked by UBehaviorSubsystem
+	bTickingTask = false;
+}
+
+void UBehavior::PostInitProperties()
+{
+	Super::PostInitProperties();
+
+	// Behaviors is read from the class defaults.
+	if (!HasAnyFlags(RF_ClassDefaultObject | RF_ArchetypeObject))
+		Behaviors.Empty();
 }
 
 void UBehavior::Activate()
 {
 	Super::Activate();
 
+	BehaviorSubsystem = GetWorld() ? GetWorld()->GetSubsystem<UBehaviorSubsystem>() : nullptr;
+	if (BehaviorSubsystem)
+		BehaviorSubsystem->RegisterBehavior(this);
+	else bTickingTask = true; // Fallback to the UGameplayTasksComponent tick
+
+	TraceEvent(EBehaviorTraceEvent::Activate);
+
+	if (LODSettings.IsValid() && InterruptRoot == this && BehaviorSubsystem)
+	{
+		BehaviorSubsystem->RegisterLODRoot(this);
+		bLODRegistered = true;
+	}
+
+	// Soft classes this chain can run are loaded before they are selected.
+	if (InterruptRoot == this && BehaviorSubsystem)
+		BehaviorSubsystem->GetClassLoader()->Preload(GetClass());
+
 	BehStart();
+}
 
-	Behaviors.StableSort([](const FBehaviorData& Lhs, const FBehaviorData& Rhs) {
-		return Lhs.RandomWeight < Rhs.RandomWeight;
-		});
+void UBehavior::OnBehaviorFinishedName_Implementation(EBehaviorResult Result, FName FailedCode)
+{
+	// The string is built only for Blueprints still using the old event.
+	static const FName OldEventName = GET_FUNCTION_NAME_CHECKED(UBehavior, OnBehaviorFinished);
+	if (GetClass()->IsFunctionImplementedInScript(OldEventName))
+		OnBehaviorFinished(Result, FailedCode.IsNone() ? FString() : FailedCode.ToString());
+}
+
+void UBehavior::OnChildBehaviorFinishedName_Implementation(TSubclassOf<UBehavior> Behavior, EBehaviorResult Result, FName FailedCode)
+{
+	static const FName OldEventName = GET_FUNCTION_NAME_CHECKED(UBehavior, OnChildBehaviorFinished);
+	if (GetClass()->IsFunctionImplementedInScript(OldEventName))
+		OnChildBehaviorFinished(Behavior, Result, FailedCode.IsNone() ? FString() : FailedCode.ToString());
+}
+
+void UBehavior::InitTask(IGameplayTaskOwnerInterface& InTaskOwner, uint8 InPriority)
+{
+	Super::InitTask(InTaskOwner, InPriority);
+	IncLiveBehaviorStat(Type);
+
+	ParentBehavior = Cast<UBehavior>(TaskOwner.GetObject());
+	LastBehavior = this;
+	if (ParentBehavior)
+	{
+		RootBehavior = ParentBehavior->RootBehavior;
+		InterruptRoot = ParentBehavior->InterruptRoot;
+		Depth = ParentBehavior->Depth + 1;
+		ParentBehavior->ActiveChild = this;
+		ParentBehavior->UpdateLastBehavior();
+	}
+	else
+	{
+		RootBehavior = BehaviorIsOwnedByTasksComponent() ? this : nullptr;
+		InterruptRoot = this;
+		Depth = 0;
+	}
+}
+
+void UBehavior::UpdateLastBehavior()
+{
+	UBehavior* Last = IsValid(ActiveChild) ? ActiveChild->LastBehavior : this;
+	for (UBehavior* Node = this; Node; Node = Node->ParentBehavior)
+	{
+		Node->LastBehavior = Last;
+		if (!Node->ParentBehavior || Node->ParentBehavior->ActiveChild != Node)
+			break;
+	}
 }
 
 void UBehavior::TickTask(float DeltaTime)
 {
 	Super::TickTask(DeltaTime);
-	BehTick(DeltaTime);
+	TickBehavior(DeltaTime, true);
+}
+
+void UBehavior::TickBehavior(float DeltaTime, bool bDispatchBehTick)
+{
+	BEHAVIOR_SCOPE_CYCLE_COUNTER(STAT_BehaviorTick);
+
+	if (bDispatchBehTick)
+		BehTick(DeltaTime);
 
 	if (!IsInterrupted() && m_bNeedToFinish)
 	{
@@ -39,33 +169,72 @@ void UBehavior::TickTask(float DeltaTime)
 	}
 
 	// Wait for behavior Queue
-	if (!IsInterrupted() && IsValid(TaskQueue))
+	if (!IsInterrupted() && TaskQueue.Num() > 0)
 	{
-		if (TaskQueue->Type == BT_Base)
+		if (TaskQueue[0].Type == BT_Base)
 		{
-			UBehavior* BehaviorBase = GetBehaviorOwner()->GetChildBehavior();
+			UBehavior* BehaviorBase = GetBehaviorOwner() ? GetBehaviorOwner()->GetChildBehavior() : nullptr;
 			if (IsValid(BehaviorBase) && !BehaviorBase->IsFinished())
-				BehaviorBase->FinishBehavior(BR_Skipped, "OverrideTask");
+			{
+				INC_DWORD_STAT(STAT_BehaviorOverrides);
+				BehaviorBase->FinishBehavior(BR_Skipped, BehaviorCodes::OverrideTask);
+			}
 		}
-		else if (GetChildBehavior() && TaskQueue->Priority > GetChildBehavior()->Priority)
-			return;
-
-		if (TaskQueue->GetState() == EGameplayTaskState::Uninitialized)
+		else if (UBehavior* Child = GetChildBehavior())
 		{
-			TaskQueue->InitTask(TaskQueue->Type == BT_Base ? *GetBehaviorOwner() : *this, TaskQueue->Priority);
-			TaskQueue->ReadyForActivation();
-			TaskQueue = nullptr;
+			if (TaskQueue[0].Priority > Child->Priority)
+				return;
+
+			// InitTask of the dequeued Behavior ends the current child (UGameplayTask has one child).
+			if (!Child->IsFinished())
+				INC_DWORD_STAT(STAT_BehaviorOverrides);
 		}
+
+		// The override could finish us too.
+		if (TaskQueue.Num() > 0 && IsBehaviorValid())
+			DequeueBehavior();
 	}
 
 	if (Type == BT_Base)
 	{
-		// Reduce cooldown
-		for (int i = 0; i < Behaviors.Num(); i++)
-			Behaviors[i].CurrentCooldown = FMath::Clamp(Behaviors[i].CurrentCooldown - DeltaTime, 0.f, Behaviors[i].Cooldown);
+		SyncStage();
+		SyncLoadedClasses();
+		ExpireCooldowns(GetWorld()->GetTimeSeconds());
 
-		SelectBehavior();
+		// Nothing can be selected until then.
+		if (!IsSelectionFrozen() && GetNextEligibleTime() <= GetWorld()->GetTimeSeconds() && !IsValid(GetChildBehavior()))
+		{
+			// Selections are spread across frames by UBehaviorSubsystem.
+			if (BehaviorSubsystem && GetNumBehaviors() > 0)
+				BehaviorSubsystem->RequestSelection(this);
+			else SelectBehavior();
+		}
 	}
+
+	if (bTickOnDemand && !bDispatchBehTick && BehaviorSubsystem && !HasPendingWork())
+	{
+		if (Type == BT_Base && !IsValid(GetChildBehavior()) && !bSelectionQueued)
+			ScheduleCooldownWake();
+		BehaviorSubsystem->SleepBehavior(this);
+	}
+}
+
+bool UBehavior::HasPendingWork()
+{
+	if (!IsInterrupted() && (m_bNeedToFinish || TaskQueue.Num() > 0))
+		return true;
+
+	// Cooldowns are expired lazily, only selection needs a tick (a scheduled one doesn't).
+	if (Type == BT_Base && !IsValid(GetChildBehavior()))
+		return !bSelectionQueued && !IsSelectionFrozen() && GetNextEligibleTime() <= GetWorld()->GetTimeSeconds();
+
+	return false;
+}
+
+void UBehavior::WakeBehavior()
+{
+	if (bSleeping && BehaviorSubsystem)
+		BehaviorSubsystem->WakeBehavior(this);
 }
 
 /*void UBehavior::NotifyAnim_Implementation(const UNativeAnimNotify* AnimNotify, class UAnimSequenceBase* Animation)
@@ -82,45 +251,58 @@ UBehavior* UBehavior::RunBehavior(TSubclassOf<UBehavior> Behavior, bool bReady)
 		return nullptr;
 	}
 
-	UBehavior* BehNew = NewObject<UBehavior>(this, Behavior);
+	BEHAVIOR_SCOPE_CYCLE_COUNTER(STAT_BehaviorRun);
+
+	UBehaviorPool* Pool = GetPool();
+	UBehavior* BehNew = Pool ? Pool->Acquire(this, Behavior) : NewObject<UBehavior>(this, Behavior);
+
+	BehNew->BehaviorSubsystem = BehaviorSubsystem;
 
 	switch (BehNew->Type)
 	{
 	case BT_Parallel:
 		BehNew->InitTask(*GetGameplayTasksComponent(), BehNew->Priority);
+		if (BehaviorSubsystem)
+			BehaviorSubsystem->AddParallelBehavior(BehNew);
+		BehNew->TraceEvent(EBehaviorTraceEvent::Run);
 		if (bReady)
 			BehNew->ReadyForActivation();
 		break;
 	case BT_Default:
-		if (!IsValid(GetChildBehavior()) || BehNew->Priority <= GetChildBehavior()->Priority && !GetChildBehavior()->IsInterrupted())
+		if (!ShouldQueue(BT_Default, BehNew->Priority))
 		{
 			if (IsValid(GetChildBehavior()) && !GetChildBehavior()->IsFinished())
-				GetChildBehavior()->FinishBehavior(BR_Skipped, "OverrideTask");
+			{
+				INC_DWORD_STAT(STAT_BehaviorOverrides);
+				GetChildBehavior()->FinishBehavior(BR_Skipped, BehaviorCodes::OverrideTask);
+			}
 
 			BehNew->InitTask(*this, BehNew->Priority);
+			BehNew->TraceEvent(EBehaviorTraceEvent::Run);
 			if (bReady)
 				BehNew->ReadyForActivation();
 		}
 		else
 		{
-			if (TaskQueue) TaskQueue->MarkPendingKill();
-			TaskQueue = BehNew;
+			if (!PushQueue(FBehaviorQueueEntry(BehNew)))
+				return nullptr;
 		}
 		break;
 	case BT_Base:
 		if (!GetBehaviorOwner())
 			break;
 
-		if (!IsInterrupted())
+		if (!ShouldQueue(BT_Base, BehNew->Priority))
 		{
 			BehNew->InitTask(*GetBehaviorOwner(), BehNew->Priority);
+			BehNew->TraceEvent(EBehaviorTraceEvent::Run);
 			if (bReady)
 				BehNew->ReadyForActivation();
 		}
 		else
 		{
-			if (TaskQueue) TaskQueue->MarkPendingKill();
-			TaskQueue = BehNew;
+			if (!PushQueue(FBehaviorQueueEntry(BehNew)))
+				return nullptr;
 		}
 		break;
 	}
@@ -128,114 +310,461 @@ UBehavior* UBehavior::RunBehavior(TSubclassOf<UBehavior> Behavior, bool bReady)
 	return BehNew;
 }
 
-void UBehavior::FinishBehavior(TEnumAsByte<EBehaviorResult> Result, const FString& FailedCode)
+UBehavior* UBehavior::RunBehaviorSoft(TSoftClassPtr<UBehavior> Behavior, bool bReady)
+{
+	if (UClass* Class = Behavior.Get())
+		return RunBehavior(Class, bReady);
+
+	UBehaviorClassLoader* Loader = BehaviorSubsystem ? BehaviorSubsystem->GetClassLoader() : nullptr;
+	if (!Loader)
+		return RunBehavior(Behavior.LoadSynchronous(), bReady);
+
+	TWeakObjectPtr<UBehavior> WeakThis(this);
+	const uint32 Generation = PoolGeneration;
+	Loader->Request(Behavior, [WeakThis, Generation, bReady](UClass* Class)
+	{
+		// Generation: the Behavior could be finished and reused by the pool.
+		UBehavior* This = WeakThis.Get();
+		if (Class && This && This->IsBehaviorValid() && This->PoolGeneration == Generation)
+			This->RunBehavior(Class, bReady);
+	});
+	return nullptr;
+}
+
+UBehavior* UBehavior::RunBehaviorRequest(const FBehaviorRequest& Request)
+{
+	if (!IsValid(Request.Class))
+	{
+		UE_LOG(LogBehavior, Error, TEXT("Behavior is invalid: %s)."), *GetFullName());
+		return nullptr;
+	}
+
+	const UBehavior* Defaults = Request.Class.GetDefaultObject();
+	if (Defaults->Type != BT_Parallel && ShouldQueue(Defaults->Type, Defaults->Priority))
+	{
+		if (Defaults->Type != BT_Base || GetBehaviorOwner())
+			PushQueue(FBehaviorQueueEntry(Request));
+		return nullptr;
+	}
+
+	UBehavior* BehNew = RunBehavior(Request.Class, false);
+	if (!BehNew)
+		return nullptr;
+
+	BehNew->ApplyRequest(Request);
+	BehNew->Ready();
+	return BehNew;
+}
+
+bool UBehavior::ShouldQueue(EBehaviorType NewType, uint8 NewPriority) const
+{
+	if (NewType == BT_Base)
+		return IsInterrupted();
+
+	UBehavior* Child = GetChildBehavior();
+	return Child && (NewPriority > Child->Priority || Child->IsInterrupted());
+}
+
+void UBehavior::FinishBehavior(TEnumAsByte<EBehaviorResult> Result, FName FailedCode)
 {
 	if (IsBehaviorValid())
 	{
 		if (bIsFinishing)
 			return;
 
-		bIsFinishing = true;
+		BEHAVIOR_SCOPE_CYCLE_COUNTER(STAT_BehaviorFinish);
 
-		// We finish child tasks ourselves, because we need to use FinishBehavior() instead EndTask() 
-		UBehavior* Child = GetChildBehavior();
-		if (IsValid(Child) && Child->IsBehaviorValid())
+		// We finish child tasks ourselves, because we need to use FinishBehavior() instead EndTask().
+		// The chain is collected first and finished from the leaf, without recursion.
+		TArray<UBehavior*, TInlineAllocator<16>> Chain;
+		for (UBehavior* Node = this; Node && Node->IsBehaviorValid() && !Node->bIsFinishing; Node = Node->GetChildBehavior())
 		{
-			Child->FinishBehavior(BR_Skipped, "BehAbort");
+			Node->bIsFinishing = true;
+			Node->FinishResult = Node == this ? Result : TEnumAsByte<EBehaviorResult>(BR_Skipped);
+			Node->FinishFailedCode = Node == this ? FailedCode : BehaviorCodes::BehAbort;
+			Node->TraceEvent(EBehaviorTraceEvent::Finish, Node->FinishResult, Node->FinishFailedCode);
+			Chain.Add(Node);
 		}
+		INC_DWORD_STAT_BY(STAT_BehaviorFinished, Chain.Num());
 
-		FinishResult = Result;
-		FinishFailedCode = FailedCode;
-
-		if (IsInterrupted())
+		// We can be released to the pool by EndTask.
+		UBehaviorSubsystem* Subsystem = BehaviorSubsystem;
+		if (Subsystem)
+			Subsystem->BeginFinishCascade();
+		for (int32 i = Chain.Num() - 1; i >= 0; i--)
 		{
-			m_bNeedToFinish = true;
-			return;
+			UBehavior* Node = Chain[i];
+			if (Node->IsInterrupted())
+				Node->m_bNeedToFinish = true;
+			else if (Node->IsBehaviorValid())
+				Node->EndTask();
 		}
-		else EndTask();
+		if (Subsystem)
+			Subsystem->EndFinishCascade();
 	}
 	else UE_LOG(LogBehavior, Warning, TEXT("The task is already finished or invalid: %s)."), *GetFullName());
 }
 
+void UBehavior::ContinueBase()
+{
+	if (RepeatCount < MaxRandomRepeat)
+	{
+		RepeatCount++;
+		if (UBehavior* BehRepeat = RunBehavior(Selector.GetTable().GetClass(SelectedIndex), false))
+		{
+			BehRepeat->bOwnedByBase = true;
+			BehRepeat->Ready();
+		}
+	}
+	else
+	{
+		// Cooldown after end repeat
+		StartCooldown(SelectedIndex);
+	}
+}
+
 void UBehavior::OnDestroy(bool bInOwnerFinished)
 {
-	OnBehaviorFinished(FinishResult, FinishFailedCode);
+	// Already released: a stale reference ended us again.
+	if (bInPool)
+		return;
+
+	TraceEvent(EBehaviorTraceEvent::Destroy, FinishResult, FinishFailedCode);
+
+	// Don't keep the parents locked
+	if (bIsInterrupted)
+		SetIsInterrupted(false);
+
+	if (TaskState != EGameplayTaskState::Uninitialized)
+		DecLiveBehaviorStat(Type);
+
+	ClearQueue();
+
+	if (BehaviorSubsystem)
+	{
+		BehaviorSubsystem->UnregisterBehavior(this);
+		BehaviorSubsystem->RemoveParallelBehavior(this);
+		if (bLODRegistered)
+			BehaviorSubsystem->UnregisterLODRoot(this);
+		if (bStageExhausted)
+			BehaviorSubsystem->RemoveExhaustedBase(this);
+	}
+	bStageExhausted = false;
+	bLODRegistered = false;
+
+	OnBehaviorFinishedName(FinishResult, FinishFailedCode);
 
 	UBehavior* Parent = GetParentBehavior();
 	if (IsValid(Parent))
 	{
-		Parent->OnChildBehaviorFinished(GetClass(), FinishResult, *FinishFailedCode);
+		Parent->WakeBehavior();
+		Parent->OnChildBehaviorFinishedName(GetClass(), FinishResult, FinishFailedCode);
 
-		if (Parent->Type == BT_Base && Parent->GetChildBehavior() == this && bOwnedByBase)
+		// A finishing Base doesn't repeat, the others wait until the finish cascade is done.
+		if (Parent->Type == BT_Base && Parent->GetChildBehavior() == this && bOwnedByBase && !Parent->bIsFinishing)
 		{
-			if (Parent->RepeatCount < Parent->MaxRandomRepeat)
-			{
-				Parent->RepeatCount++;
-				UBehavior* NewBeh = Parent->RunBehavior(
-					Parent->Behaviors[Parent->SelectedIndex].Behavior, true);
-			}
-			else
-			{
-				// Cooldown after end repeat
-				Parent->Behaviors[Parent->SelectedIndex].CurrentCooldown =
-					Parent->Behaviors[Parent->SelectedIndex].Cooldown;
-			}
+			if (!BehaviorSubsystem || !BehaviorSubsystem->DeferBaseRepeat(Parent))
+				Parent->ContinueBase();
 		}
 	}
 
+	if (IsValid(Parent) && Parent->ActiveChild == this)
+	{
+		Parent->ActiveChild = nullptr;
+		Parent->UpdateLastBehavior();
+	}
+
 	if (IsBehaviorValid())
+	{
+		UBehaviorPool* Pool = GetPool();
+		const bool bReleased = Pool && Pool->Release(this);
+		if (bReleased)
+		{
+			UnbindAgentDelegates();
+
+			// The parent would EndTask us again when it's deactivated, after we were reused by another agent.
+			if (IsValid(Parent) && Parent->ChildTask == this)
+				Parent->ChildTask = nullptr;
+		}
+
 		Super::OnDestroy(bInOwnerFinished);
+
+		// The pool keeps us alive.
+		if (bReleased)
+			ClearPendingKill();
+	}
 }
 
-void UBehavior::SetIsInterrupted(bool IsInterrupted)
+void UBehavior::UnbindAgentDelegates()
 {
-	bIsInterrupted = IsInterrupted;
+	TArray<AActor*, TInlineAllocator<2>> Actors;
+	if (AActor* Actor = GetOwnerActor())
+	{
+		Actors.Add(Actor);
+		if (const APawn* Pawn = Cast<APawn>(Actor))
+			if (Pawn->GetController())
+				Actors.Add(Pawn->GetController());
+	}
+
+	auto Unbind = [this](UObject* Object)
+	{
+		for (TFieldIterator<FMulticastInlineDelegateProperty> It(Object->GetClass()); It; ++It)
+			It->ContainerPtrToValuePtr<FMulticastScriptDelegate>(Object)->RemoveAll(this);
+	};
 
-	if (IsValid(GetParentBehavior()))
-		GetParentBehavior()->SetIsInterrupted(IsInterrupted);
+	for (AActor* Actor : Actors)
+	{
+		Unbind(Actor);
+		for (UActorComponent* Component : Actor->GetComponents())
+			if (Component)
+				Unbind(Component);
+	}
 }
 
-TArray<FString> UBehavior::GetDebugHierarchi()
+void UBehavior::ResetBehavior()
 {
-	if (IsPendingKill())
-		return {};
+	// UPROPERTYs of UBehavior and its subclasses (TaskQueue, bIsInterrupted, bIsFinishing, Blueprint variables and delegates).
+	// UGameplayTask state is reset below, like a new task.
+	UBehavior* Defaults = GetClass()->GetDefaultObject<UBehavior>();
+	static const FName BehaviorsName = GET_MEMBER_NAME_CHECKED(UBehavior, Behaviors);
+	for (TFieldIterator<FProperty> It(GetClass()); It; ++It)
+	{
+		if (!It->GetOwnerClass() || !It->GetOwnerClass()->IsChildOf(UBehavior::StaticClass()))
+			continue;
+		// Behaviors is read from the class defaults.
+		if (It->GetFName() == BehaviorsName && It->GetOwnerClass() == UBehavior::StaticClass())
+			continue;
+		It->CopyCompleteValue_InContainer(this, Defaults);
+	}
 
-	TArray<FString> Result;
-	if (GetParentBehavior())
-		Result.Add(GetFName().GetPlainNameString());
+	// Timers set by BehDelay are ignored after this.
+	PoolGeneration++;
+	if (GetWorld())
+		GetWorld()->GetTimerManager().ClearAllTimersForObject(this);
 
-	if (Cast<UBehavior>(GetChildTask()))
-		Result.Append(Cast<UBehavior>(GetChildTask())->GetDebugHierarchi());
+	TaskState = EGameplayTaskState::Uninitialized;
+	TaskOwner.Reset();
+	TasksComponent.Reset();
+	ChildTask = nullptr;
+	bTickingTask = false;
 
-	return Result;
+	Selector.Reset();
+	BaseState.Reset();
+	StageEpoch = 0;
+	bStageExhausted = false;
+	ClassLoadEpoch = 0;
+	Cooldowns.Reset();
+	RepeatCount = MaxRandomRepeat = SelectedIndex = 0;
+	bSelectingTask = false;
+	FinishResult = BR_Skipped;
+	FinishFailedCode = NAME_None;
+	bOwnedByBase = false;
+	m_bNeedToFinish = false;
+	BehaviorSubsystem = nullptr;
+	bInParallelIndex = false;
+	Depth = 0;
+	InterruptLocks.Reset();
+	DeepestInterrupt = INDEX_NONE;
+	bSelectionQueued = false;
+	LODSettings.Reset();
+	LODLevel = 0;
+	LODAccumulatedTime = LODDeltaTime = 0.f;
+	bLODTick = true;
+	bLODRegistered = false;
 }
 
-UBehavior* UBehavior::GetParentBehavior()
+void UBehavior::RecordTraceEvent(EBehaviorTraceEvent Event, uint8 Result, FName FailedCode) const
 {
-	if (IsValid(TaskOwner.GetObject()) && TaskOwner.GetObject()->IsA(UBehavior::StaticClass()))
-		return Cast<UBehavior>(TaskOwner.GetObject());
-	else return nullptr;
+	BehaviorSubsystem->GetTrace().Record(Event, this, Result, FailedCode);
 }
 
-UBehavior* UBehavior::GetChildBehavior()
+UBehaviorPool* UBehavior::GetPool() const
 {
-	return Cast<UBehavior>(GetChildTask());
+	return BehaviorSubsystem ? BehaviorSubsystem->GetPool() : nullptr;
 }
 
-UBehavior* UBehavior::GetBehaviorOwner()
+void UBehavior::DiscardBehavior(UBehavior* Behavior)
 {
-	if (IsValid(GetParentBehavior()))
-		return GetParentBehavior();
-	else if (BehaviorIsOwnedByTasksComponent())
-		return this;
-	else return nullptr;
+	UBehaviorPool* Pool = GetPool();
+	if (!Pool || !Pool->Release(Behavior))
+		Behavior->MarkPendingKill();
+}
+
+bool UBehavior::QueueBehavior(TSubclassOf<UBehavior> Behavior)
+{
+	if (!IsValid(Behavior))
+	{
+		UE_LOG(LogBehavior, Error, TEXT("Behavior is invalid: %s)."), *GetFullName());
+		return false;
+	}
+
+	// Parallel Behaviors don't wait for anything.
+	if (Behavior.GetDefaultObject()->Type == BT_Parallel)
+		return RunBehavior(Behavior) != nullptr;
+
+	return PushQueue(FBehaviorQueueEntry(FBehaviorRequest(Behavior)));
+}
+
+bool UBehavior::PushQueue(const FBehaviorQueueEntry& Entry)
+{
+	if (TaskQueue.Num() >= FMath::Max(MaxQueueSize, 1))
+	{
+		int32 DropIndex = INDEX_NONE;
+		switch (QueueOverflow)
+		{
+		case EBehaviorQueueOverflow::DropLowest:
+			// The last entry has the lowest priority and was queued last, so it loses ties.
+			if (Entry.Priority < TaskQueue.Last().Priority)
+				DropIndex = TaskQueue.Num() - 1;
+			break;
+		case EBehaviorQueueOverflow::ReplaceSameClass:
+			DropIndex = TaskQueue.IndexOfByPredicate([&Entry](const FBehaviorQueueEntry& Queued) { return Queued.Request.Class == Entry.Request.Class; });
+			break;
+		default:
+			break;
+		}
+
+		if (DropIndex == INDEX_NONE)
+		{
+			INC_DWORD_STAT(STAT_BehaviorQueueRejected);
+			DiscardQueueEntry(Entry);
+			return false;
+		}
+
+		INC_DWORD_STAT(STAT_BehaviorQueueDropped);
+		DiscardQueueEntry(TaskQueue[DropIndex]);
+		TaskQueue.RemoveAt(DropIndex, 1, false);
+		DEC_DWORD_STAT(STAT_BehaviorNumQueued);
+	}
+
+	// After every entry with the same or a higher priority
+	int32 Index = TaskQueue.Num();
+	while (Index > 0 && TaskQueue[Index - 1].Priority > Entry.Priority)
+		Index--;
+	TaskQueue.Insert(Entry, Index);
+	INC_DWORD_STAT(STAT_BehaviorNumQueued);
+
+	if (Entry.Behavior)
+		Entry.Behavior->TraceEvent(EBehaviorTraceEvent::Queue);
+	WakeBehavior();
+	return true;
+}
+
+void UBehavior::DequeueBehavior()
+{
+	const FBehaviorQueueEntry Entry = TaskQueue[0];
+	TaskQueue.RemoveAt(0, 1, false);
+	DEC_DWORD_STAT(STAT_BehaviorNumQueued);
+
+	UBehavior* Owner = Entry.Type == BT_Base ? GetBehaviorOwner() : this;
+	if (!Owner || !IsValid(Entry.Request.Class))
+	{
+		DiscardQueueEntry(Entry);
+		return;
+	}
+
+	UBehavior* BehNew = Entry.Behavior;
+	if (!BehNew)
+	{
+		UBehaviorPool* Pool = GetPool();
+		BehNew = Pool ? Pool->Acquire(this, Entry.Request.Class) : NewObject<UBehavior>(this, Entry.Request.Class);
+		BehNew->BehaviorSubsystem = BehaviorSubsystem;
+	}
+
+	if (BehNew->GetState() == EGameplayTaskState::Uninitialized)
+	{
+		BehNew->InitTask(*Owner, BehNew->Priority);
+		if (!Entry.Behavior)
+			BehNew->ApplyRequest(Entry.Request);
+		BehNew->TraceEvent(EBehaviorTraceEvent::Run);
+		BehNew->ReadyForActivation();
+	}
+}
+
+void UBehavior::DiscardQueueEntry(const FBehaviorQueueEntry& Entry)
+{
+	if (Entry.Behavior)
+		DiscardBehavior(Entry.Behavior);
+}
+
+void UBehavior::ClearQueue()
+{
+	DEC_DWORD_STAT_BY(STAT_BehaviorNumQueued, TaskQueue.Num());
+	for (const FBehaviorQueueEntry& Entry : TaskQueue)
+		DiscardQueueEntry(Entry);
+	TaskQueue.Reset();
 }
 
-UBehavior* UBehavior::GetLastBehavior()
+void UBehavior::SetIsInterrupted(bool IsInterrupted)
+{
+	// One lock per Behavior
+	if (bIsInterrupted == IsInterrupted)
+		return;
+
+	bIsInterrupted = IsInterrupted;
+	TraceEvent(IsInterrupted ? EBehaviorTraceEvent::Interrupt : EBehaviorTraceEvent::Resume);
+
+	UBehavior* Root = InterruptRoot ? InterruptRoot : this;
+	if (IsInterrupted)
+	{
+		Root->AddInterruptLock(Depth);
+		return;
+	}
+
+	// Only we and the parents up to the deepest lock left are released.
+	const int32 LockedDepth = Root->RemoveInterruptLock(Depth);
+	for (UBehavior* Node = this; Node && Node->Depth > LockedDepth; Node = Node->ParentBehavior)
+	{
+		Node->WakeBehavior();
+
+		// Finished while interrupted, UBehaviorSubsystem finishes them all at once.
+		if (Node->m_bNeedToFinish && Node->BehaviorSubsystem)
+			Node->BehaviorSubsystem->AddPendingFinish(Node);
+	}
+}
+
+void UBehavior::AddInterruptLock(int32 LockDepth)
+{
+	if (InterruptLocks.Num() <= LockDepth)
+		InterruptLocks.SetNumZeroed(LockDepth + 1);
+
+	InterruptLocks[LockDepth]++;
+	DeepestInterrupt = FMath::Max(DeepestInterrupt, LockDepth);
+}
+
+int32 UBehavior::RemoveInterruptLock(int32 LockDepth)
+{
+	if (InterruptLocks.IsValidIndex(LockDepth) && InterruptLocks[LockDepth] > 0)
+		InterruptLocks[LockDepth]--;
+
+	while (DeepestInterrupt >= 0 && InterruptLocks[DeepestInterrupt] == 0)
+		DeepestInterrupt--;
+
+	return DeepestInterrupt;
+}
+
+void UBehavior::FlushPendingFinish()
+{
+	if (m_bNeedToFinish && !IsInterrupted() && IsBehaviorValid())
+	{
+		m_bNeedToFinish = false;
+		EndTask();
+	}
+}
+
+TArray<FString> UBehavior::GetDebugHierarchi()
 {
-	if (IsValid(GetChildBehavior()))
-		return GetChildBehavior()->GetLastBehavior();
-	else return this;
+	if (IsPendingKill())
+		return {};
+
+	TArray<FString> Result;
+	if (GetParentBehavior())
+		Result.Add(GetFName().GetPlainNameString());
+
+	if (GetChildBehavior())
+		Result.Append(GetChildBehavior()->GetDebugHierarchi());
+
+	return Result;
 }
 
 void UBehavior::Ready()
@@ -250,15 +779,29 @@ void UBehavior::Ready()
 
 TArray<UBehavior*> UBehavior::GetParallelBehaviors()
 {
-	TArray<UBehavior*> Result;
-	if (GetGameplayTasksComponent())
-		for (auto Task = GetGameplayTasksComponent()->GetKnownTaskIterator(); Task; ++Task)
-		{
-			UBehavior* BehCast = Cast<UBehavior>(*Task);
-			if (IsValid(BehCast) && BehCast->Type == BT_Parallel)
-				Result.Add(BehCast);
-		}
-	return Result;
+	const TArrayView<UBehavior* const> Parallels = GetParallelBehaviorsView();
+	return TArray<UBehavior*>(Parallels.GetData(), Parallels.Num());
+}
+
+void UBehavior::GetParallelBehaviorsOfClass(TSubclassOf<UBehavior> Class, TArray<UBehavior*>& OutBehaviors)
+{
+	OutBehaviors.Reset();
+	for (UBehavior* Parallel : GetParallelBehaviorsView())
+		if (IsValid(Parallel) && (!Class || Parallel->IsA(Class)))
+			OutBehaviors.Add(Parallel);
+}
+
+UBehavior* UBehavior::FindParallelBehavior(TSubclassOf<UBehavior> Class)
+{
+	for (UBehavior* Parallel : GetParallelBehaviorsView())
+		if (IsValid(Parallel) && (!Class || Parallel->IsA(Class)))
+			return Parallel;
+	return nullptr;
+}
+
+TArrayView<UBehavior* const> UBehavior::GetParallelBehaviorsView() const
+{
+	return BehaviorSubsystem ? BehaviorSubsystem->GetParallelBehaviors(GetGameplayTasksComponent()) : TArrayView<UBehavior* const>();
 }
 
 class AAIController* UBehavior::GetAIController()
@@ -273,82 +816,364 @@ class AAIController* UBehavior::GetAIController()
 
 void UBehavior::SelectBehavior()
 {
-	if (IsBehaviorValid() && Behaviors.Num() > 0 && !bSelectingTask && !IsValid(GetChildBehavior()))
+	if (CanSelectBehavior())
+	{
+		BEHAVIOR_SCOPE_CYCLE_COUNTER(STAT_BehaviorSelect);
+		ApplySelection(PrepareSelection(GetWorld()->GetTimeSeconds()));
+	}
+}
+
+bool UBehavior::CanSelectBehavior()
+{
+	if (GetNumBehaviors() == 0)
+	{
+		UE_LOG(LogBehavior, Error, TEXT("Behavior Type is BT_Base, but Behaviors array is empty: %s"), *GetFullName());
+		return false;
+	}
+
+	if (!IsBehaviorValid() || bSelectingTask || IsValid(GetChildBehavior()))
+		return false;
+
+	// The set can be recompiled while playing in the editor.
+	if (!Selector.IsInitialized() || Selector.Num() != GetNumBehaviors())
+		InitSelector();
+	SyncStage();
+	SyncLoadedClasses();
+	return true;
+}
+
+FBehaviorSelectionDecision UBehavior::PrepareSelection(float Now)
+{
+	FBehaviorSelectionDecision Decision;
+	Decision.Base = this;
+	Decision.PoolGeneration = PoolGeneration;
+
+	ExpireCooldowns(Now);
+	if (GetNextEligibleTimeAt(Now) > Now)
+		return Decision;
+
+	if (Selector.GetTotalWeight() <= 0.f && Selector.GetNumEligible() == Selector.Num())
+	{
+		Decision.bZeroWeight = true;
+		return Decision;
+	}
+
+	Decision.Index = Selector.Select(RandomStream);
+	if (Decision.Index != INDEX_NONE)
+		Decision.MaxRandRepeat = RandomStream.RandRange(0, Selector.GetTable().MaxRandRepeat[Decision.Index]);
+	return Decision;
+}
+
+void UBehavior::ApplySelection(const FBehaviorSelectionDecision& Decision)
+{
+	// Finished, reused or already selected by a decision applied before this one.
+	if (Decision.PoolGeneration != PoolGeneration || !IsBehaviorValid() || bSelectingTask || IsValid(GetChildBehavior()))
+		return;
+
+	if (Decision.bZeroWeight)
 	{
-		SelectedIndex = 0;
 		bSelectingTask = true;
-		float TotalWeight = 0.f;
-		TArray<bool> FailedBehaviors; 
-
-		// Sum weight
-		for (const FBehaviorData& BehData : Behaviors)
-			if (CanExecuteBehavior(BehData))
-				{
-				TotalWeight += BehData.RandomWeight;
-					FailedBehaviors.Add(false);
-				}
-			else FailedBehaviors.Add(true);
-
-		if (TotalWeight <= 0.f && !FailedBehaviors.Contains(true))
+		UE_LOG(LogBehavior, Error, TEXT("All tasks have zero weight: %s"), *GetFullName());
+		if (IsValid(GetParentBehavior()))
+			GetParentBehavior()->FinishBehavior(BR_Failed, BehaviorCodes::BaseZeroWeight);
+		return;
+	}
+
+	if (!BaseState.PerStage.IsValidIndex(Decision.Index))
+	{
+		OnSelectionDropped();
+		return;
+	}
+
+	bSelectingTask = true;
+	INC_DWORD_STAT(STAT_BehaviorSelections);
+	SelectedIndex = Decision.Index;
+	MaxRandomRepeat = Decision.MaxRandRepeat;
+	RepeatCount = 0;
+	UBehavior* BehRandom = RunBehavior(Selector.GetTable().GetClass(SelectedIndex), false);
+	if (BehRandom)
+	{
+		BehRandom->bOwnedByBase = true;
+		BehRandom->Ready();
+	}
+	BaseState.PerStage[SelectedIndex]++;
+	UpdateEligibility(SelectedIndex);
+	bSelectingTask = false;
+
+	if (!IsValid(GetChildBehavior()))
+		OnSelectionDropped();
+}
+
+void UBehavior::OnSelectionDropped()
+{
+	// Awake Bases request again in TickBehavior, sleeping ones skipped ScheduleCooldownWake while the selection was queued.
+	if (Type != BT_Base || !bSleeping || bSelectionQueued || !IsBehaviorValid() || IsValid(GetChildBehavior()) || GetNumBehaviors() == 0)
+		return;
+
+	ScheduleCooldownWake();
+}
+
+bool UBehavior::IsSelectionFrozen() const
+{
+	const UBehavior* Root = InterruptRoot ? InterruptRoot : this;
+	return Root->LODLevel > 0 && Root->LODSettings.IsValid() && Root->LODSettings->Bands.IsValidIndex(Root->LODLevel - 1) &&
+		Root->LODSettings->Bands[Root->LODLevel - 1].bFreezeSelection;
+}
+
+void UBehavior::SetLODSettings(const FBehaviorLODSettings& Settings)
+{
+	// LOD is updated by the subsystem.
+	UBehaviorSubsystem* Subsystem = GetWorld() ? GetWorld()->GetSubsystem<UBehaviorSubsystem>() : nullptr;
+	LODSettings = Settings.bEnabled && Subsystem ? Subsystem->GetLODSettings(Settings) : nullptr;
+}
+
+void UBehavior::UpdateLOD(float DeltaTime, const TArray<FVector>& ViewLocations)
+{
+	// Disabled after activation
+	if (!LODSettings.IsValid())
+	{
+		bLODTick = true;
+		if (LODLevel != 0)
 		{
-			UE_LOG(LogBehavior, Error, TEXT("All tasks have zero weight: %s"), *GetFullName());
-			GetParentBehavior()->FinishBehavior(BR_Failed, "BehBase_Failed_Weight=ZERO");
-			return;
+			LODLevel = 0;
+			for (UBehavior* Node = this; Node; Node = Node->GetChildBehavior())
+				Node->WakeBehavior();
 		}
+		return;
+	}
+
+	// No players - the farthest band
+	float DistanceSq = TNumericLimits<float>::Max();
+	if (const AActor* Actor = GetOwnerActor())
+		for (const FVector& ViewLocation : ViewLocations)
+			DistanceSq = FMath::Min(DistanceSq, FVector::DistSquared(ViewLocation, Actor->GetActorLocation()));
+	const float Distance = DistanceSq < TNumericLimits<float>::Max() ? FMath::Sqrt(DistanceSq) : DistanceSq;
+
+	const FBehaviorLODSettings& LOD = *LODSettings;
+	int32 Level = FMath::Min(LODLevel, LOD.Bands.Num());
+	while (Level < LOD.Bands.Num() && Distance >= LOD.Bands[Level].Distance + LOD.Hysteresis)
+		Level++;
+	while (Level > 0 && Distance < LOD.Bands[Level - 1].Distance - LOD.Hysteresis)
+		Level--;
+
+	if (Level != LODLevel)
+	{
+		LODLevel = Level;
+
+		// Don't tick every agent entering the band in the same frame.
+		LODAccumulatedTime = Level > 0 ? FMath::FRand() * LOD.Bands[Level - 1].TickInterval : 0.f;
+
+		// Sleeping Behaviors have to see the new band (unfrozen selection).
+		for (UBehavior* Node = this; Node; Node = Node->GetChildBehavior())
+			Node->WakeBehavior();
+	}
+
+	const float TickInterval = LODLevel > 0 ? LOD.Bands[LODLevel - 1].TickInterval : 0.f;
+	LODAccumulatedTime += DeltaTime;
+	bLODTick = LODAccumulatedTime >= TickInterval;
+	if (bLODTick)
+	{
+		LODDeltaTime = LODAccumulatedTime;
+		LODAccumulatedTime = 0.f;
+	}
+}
+
+void UBehavior::InitSelector()
+{
+	// Sets are shared by every class using them.
+	TSharedPtr<const FBehaviorSelectionTable> Table = BehaviorSet ? BehaviorSet->GetTable() :
+		BehaviorSubsystem ? BehaviorSubsystem->GetSelectionTable(this) : nullptr;
+	if (!Table.IsValid())
+		Table = MakeShared<FBehaviorSelectionTable>(GetClass()->GetDefaultObject<UBehavior>()->Behaviors);
+
+	Selector.Init(Table);
+	BaseState.Init(Table->Num());
+	StageEpoch = BehaviorSubsystem ? BehaviorSubsystem->GetStageEpoch(GetGameplayTasksComponent()) : 0;
+	SyncLoadedClasses(true);
+	for (int32 i = 0; i < Table->Num(); i++)
+		UpdateEligibility(i);
+
+	RandomStream.Initialize(RandomSeed != 0 ? RandomSeed :
+		BehaviorSubsystem ? BehaviorSubsystem->NextBehaviorSeed() : FMath::Rand());
+}
+
+void UBehavior::UpdateEligibility(int32 Index)
+{
+	if (Selector.IsInitialized() && BaseState.PerStage.IsValidIndex(Index))
+		Selector.SetEligible(Index, CanExecuteBehavior(Index));
+}
+
+void UBehavior::StartCooldown(int32 Index)
+{
+	const float Cooldown = Selector.GetTable().Cooldowns[Index];
+	if (Cooldown <= 0.f)
+		return;
 
-		float RandomPoint = FMath::FRandRange(0.f, TotalWeight);
+	BaseState.CooldownEndTimes[Index] = GetWorld()->GetTimeSeconds() + Cooldown;
+	Cooldowns.Start(Index, BaseState.CooldownEndTimes[Index]);
+	UpdateEligibility(Index);
+}
 
-		float AccumulatedWeight = 0.f;
-		for (int i = 0; i < Behaviors.Num(); i++)
+void UBehavior::ExpireCooldowns(float Now)
+{
+	Cooldowns.Expire(Now, [this](int32 Index, float EndTime)
+	{
+		// Skip restarted cooldowns
+		if (BaseState.CooldownEndTimes.IsValidIndex(Index) && BaseState.CooldownEndTimes[Index] == EndTime)
 		{
-			if (!CanExecuteBehavior(Behaviors[i]))
-				continue;
+			BaseState.CooldownEndTimes[Index] = 0.f;
+			UpdateEligibility(Index);
+		}
+	});
+}
 
-			AccumulatedWeight += Behaviors[i].RandomWeight;
-			if (RandomPoint <= AccumulatedWeight)
-			{
-				SelectedIndex = i;
-				MaxRandomRepeat = UKismetMathLibrary::RandomIntegerInRange(0, Behaviors[i].MaxRandRepeat);
-				RepeatCount = 0;
-				UBehavior* BehRandom = RunBehavior(Behaviors[i].Behavior, false);
-				BehRandom->bOwnedByBase = true;
-				BehRandom->Ready();
-				Behaviors[i].CurrentPerStage++;
-				bSelectingTask = false;
-				return;
-			}
+void UBehavior::ScheduleCooldownWake()
+{
+	// UpdateLOD wakes the chain when it leaves the band.
+	if (IsSelectionFrozen())
+		return;
+
+	const float NextTime = GetNextEligibleTime();
+	if (NextTime == TNumericLimits<float>::Max())
+	{
+		if (!bStageExhausted && BehaviorSubsystem)
+		{
+			bStageExhausted = true;
+			BehaviorSubsystem->AddExhaustedBase(this);
 		}
-		bSelectingTask = false;
+		return;
 	}
-	else if (Behaviors.Num() == 0)
-		UE_LOG(LogBehavior, Error, TEXT("Behavior Type is BT_Base, but Behaviors array is empty: %s"), *GetFullName());
+
+	BehDelay(CooldownTimerHandle, [this]()
+	{
+		WakeBehavior();
+	}, FMath::Max(NextTime - GetWorld()->GetTimeSeconds(), KINDA_SMALL_NUMBER));
 }
 
-bool UBehavior::CanExecuteBehavior(const FBehaviorData& Behavior)
+float UBehavior::GetCooldownRemaining(int32 Index) const
 {
-	return (Behavior.CurrentCooldown == 0.0f && (Behavior.MaxPerStage != Behavior.CurrentPerStage ||
-		Behavior.MaxPerStage == 0));
+	if (!BaseState.CooldownEndTimes.IsValidIndex(Index) || BaseState.CooldownEndTimes[Index] <= 0.f || !GetWorld())
+		return 0.f;
+
+	return FMath::Max(BaseState.CooldownEndTimes[Index] - GetWorld()->GetTimeSeconds(), 0.f);
+}
+
+void UBehavior::RefreshLevel()
+{
+	if (BehaviorSubsystem)
+		BehaviorSubsystem->RefreshAgentLevel(GetGameplayTasksComponent());
+}
+
+void UBehavior::SyncStage()
+{
+	if (!Selector.IsInitialized() || !BehaviorSubsystem)
+		return;
+
+	const uint32 Epoch = BehaviorSubsystem->GetStageEpoch(GetGameplayTasksComponent());
+	if (Epoch == StageEpoch)
+		return;
+
+	StageEpoch = Epoch;
+	for (int32 i = 0; i < BaseState.Num(); i++)
+	{
+		if (BaseState.PerStage[i] > 0)
+		{
+			BaseState.PerStage[i] = 0;
+			UpdateEligibility(i);
+		}
+	}
+}
+
+void UBehavior::SyncLoadedClasses(bool bForce)
+{
+	if (!Selector.IsInitialized() || Selector.GetTable().NumSoftClasses == 0)
+		return;
+
+	UBehaviorClassLoader* Loader = BehaviorSubsystem ? BehaviorSubsystem->GetClassLoader() : nullptr;
+	if (!bForce && (!Loader || Loader->GetLoadEpoch() == ClassLoadEpoch))
+		return;
+	ClassLoadEpoch = Loader ? Loader->GetLoadEpoch() : 0;
+
+	const FBehaviorSelectionTable& Table = Selector.GetTable();
+	for (int32 i = 0; i < Table.Num(); i++)
+	{
+		if (Table.SoftClasses[i].IsNull())
+			continue;
+
+		UClass* Class = Table.GetClass(i);
+		if (!Class && Loader)
+			Loader->Request(Table.SoftClasses[i]);
+		else if (!Class) // Nothing can load it asynchronously without the subsystem.
+			Class = Table.SoftClasses[i].LoadSynchronous();
+
+		const bool bUnloaded = Class == nullptr;
+		if (BaseState.Unloaded[i] != bUnloaded)
+		{
+			BaseState.Unloaded[i] = bUnloaded;
+			UpdateEligibility(i);
+		}
+	}
+}
+
+int32 UBehavior::GetPerStageCount(int32 Index) const
+{
+	return BaseState.PerStage.IsValidIndex(Index) ? BaseState.PerStage[Index] : 0;
+}
+
+int32 UBehavior::GetNumBehaviors() const
+{
+	return BehaviorSet ? BehaviorSet->Num() : GetClass()->GetDefaultObject<UBehavior>()->Behaviors.Num();
+}
+
+float UBehavior::GetNextEligibleTime() const
+{
+	return GetNextEligibleTimeAt(GetWorld() ? GetWorld()->GetTimeSeconds() : 0.f);
+}
+
+float UBehavior::GetNextEligibleTimeAt(float Now) const
+{
+	// Not initialized yet: SelectBehavior will do it.
+	if (!Selector.IsInitialized() || Selector.GetNumEligible() > 0)
+		return Now;
+
+	return FMath::Max(Cooldowns.GetNextEndTime(), Now);
+}
+
+void UBehavior::SetRandomSeed(int32 Seed)
+{
+	RandomSeed = Seed;
+	RandomStream.Initialize(Seed);
+}
+
+bool UBehavior::CanExecuteBehavior(int32 Index) const
+{
+	const int32 MaxPerStage = Selector.GetTable().MaxPerStage[Index];
+	return (!BaseState.Unloaded[Index] && BaseState.CooldownEndTimes[Index] == 0.0f && (MaxPerStage != BaseState.PerStage[Index] ||
+		MaxPerStage == 0));
 }
 
 // Custom
 void UBehavior::RunBehMove(FVector TargetLocation, float AcceptanceRadius)
 {
-	UBehMove* BehMove = Cast<UBehMove>(RunBehavior(UBehMove::StaticClass(), false));
-	BehMove->TargetLocation = TargetLocation;
-	BehMove->AcceptanceRadius = AcceptanceRadius;
-	BehMove->Ready();
+	// Chasing: a running BehMove child only changes its target.
+	UBehMove* Move = Cast<UBehMove>(GetChildBehavior());
+	if (Move && Move->IsBehaviorValid() && Move->IsActive() && TaskQueue.Num() == 0)
+	{
+		Move->SetTargetLocation(TargetLocation, AcceptanceRadius);
+		return;
+	}
+
+	RunBehaviorRequest(UBehMove::MakeRequest(TargetLocation, AcceptanceRadius));
 }
 
 UBehAnim* UBehavior::RunBehAnim(UAnimSequenceBase* Animation, bool bLooping, bool bResetPose)
 {
-	UBehAnim* BehAnim = Cast<UBehAnim>(RunBehavior(UBehAnim::StaticClass(), false));
-	if (!BehAnim)
-		return nullptr;
-	BehAnim->Animation = Animation;
-	BehAnim->bLooping = bLooping;
-	BehAnim->bResetPose = bResetPose;
-	BehAnim->Ready();
-	return BehAnim;
+	return Cast<UBehAnim>(RunBehaviorRequest(UBehAnim::MakeRequest(Animation, bLooping, bResetPose)));
+}
+
+UBehAnim* UBehavior::RunBehAnimSlot(UAnimSequenceBase* Animation, FName SlotName, float PlayRate, bool bLooping)
+{
+	return Cast<UBehAnim>(RunBehaviorRequest(UBehAnim::MakeSlotRequest(Animation, SlotName, PlayRate, bLooping)));
 }
 
 // ~Custom
@@ -5,9 +5,28 @@
 #include "CoreMinimal.h"
 #include "GameplayTask.h"
 #include "AIController.h"
+#include "BehaviorSelector.h"
+#include "Behavior/BehaviorTrace.h"
+#include "Behavior/BehaviorLOD.h"
 #include "Behavior.generated.h"
 
-DECLARE_LOG_CATEGORY_EXTERN(LogBehavior, Log, All);
+SHATALOVBEHAVIOR_API DECLARE_LOG_CATEGORY_EXTERN(LogBehavior, Log, All);
+
+// Built-in FailedCode values of FinishBehavior.
+namespace BehaviorCodes
+{
+	SHATALOVBEHAVIOR_API extern const FName OverrideTask;
+	SHATALOVBEHAVIOR_API extern const FName BehAbort;
+	SHATALOVBEHAVIOR_API extern const FName BaseZeroWeight;
+	SHATALOVBEHAVIOR_API extern const FName AIControllerError;
+	SHATALOVBEHAVIOR_API extern const FName RepeatBehMove;
+	SHATALOVBEHAVIOR_API extern const FName Blocked;
+	SHATALOVBEHAVIOR_API extern const FName OffPath;
+	SHATALOVBEHAVIOR_API extern const FName Aborted;
+	SHATALOVBEHAVIOR_API extern const FName Invalid;
+	SHATALOVBEHAVIOR_API extern const FName AnimNotSelected;
+	SHATALOVBEHAVIOR_API extern const FName FindAIInvalid;
+}
 
 UENUM(BlueprintType)
 enum EBehaviorType
@@ -25,6 +44,79 @@ enum EBehaviorResult
 	BR_Skipped UMETA(DisplayName = "Skipped", ToolTip = "Task was skipped.")
 };
 
+// What RunBehavior does with a new queued Behavior when the queue is full.
+UENUM(BlueprintType)
+enum class EBehaviorQueueOverflow : uint8
+{
+	DropLowest UMETA(ToolTip = "Drop the lowest priority (and the latest) Behavior, which can be the new one."),
+	ReplaceSameClass UMETA(ToolTip = "Replace a queued Behavior of the same class, reject the new one if there is none."),
+	Reject UMETA(ToolTip = "Reject the new Behavior.")
+};
+
+/**
+ * Behavior to start: the class and a small parameter payload, copied in the Behavior by ApplyRequest when it's created.
+ * Can be queued, replaced or discarded without creating the Behavior.
+ * Payloads are USTRUCTs, trivially destructible and not bigger than PayloadSize (use weak pointers for objects).
+ */
+USTRUCT()
+struct SHATALOVBEHAVIOR_API FBehaviorRequest
+{
+	GENERATED_BODY()
+
+	static constexpr int32 PayloadSize = 32;
+
+	FBehaviorRequest() {};
+	explicit FBehaviorRequest(TSubclassOf<UBehavior> InClass) : Class(InClass) {};
+
+	template<typename TPayload>
+	FBehaviorRequest(TSubclassOf<UBehavior> InClass, const TPayload& InPayload) : Class(InClass) { SetPayload(InPayload); };
+
+	template<typename TPayload>
+	void SetPayload(const TPayload& InPayload)
+	{
+		static_assert(sizeof(TPayload) <= PayloadSize && alignof(TPayload) <= 16, "Behavior request payload is too big.");
+		static_assert(TIsTriviallyDestructible<TPayload>::Value, "Behavior request payload must be trivially destructible.");
+		new (&Payload) TPayload(InPayload);
+		PayloadStruct = TPayload::StaticStruct();
+	}
+
+	// Null if there is no payload of this type.
+	template<typename TPayload>
+	const TPayload* GetPayload() const
+	{
+		return PayloadStruct == TPayload::StaticStruct() ? reinterpret_cast<const TPayload*>(&Payload) : nullptr;
+	}
+
+	UPROPERTY()
+	TSubclassOf<UBehavior> Class;
+
+private:
+	UScriptStruct* PayloadStruct = nullptr;
+	TAlignedBytes<PayloadSize, 16> Payload;
+};
+
+// Behavior waiting in the queue of its parent.
+USTRUCT()
+struct SHATALOVBEHAVIOR_API FBehaviorQueueEntry
+{
+	GENERATED_BODY()
+
+	FBehaviorQueueEntry() {};
+	explicit FBehaviorQueueEntry(UBehavior* InBehavior);
+	// Type and Priority of the class defaults.
+	explicit FBehaviorQueueEntry(const FBehaviorRequest& InRequest);
+
+	UPROPERTY()
+	FBehaviorRequest Request;
+
+	// Created by RunBehavior. Requests are created when they are dequeued.
+	UPROPERTY()
+	UBehavior* Behavior = nullptr;
+
+	TEnumAsByte<EBehaviorType> Type = BT_Default;
+	uint8 Priority = 127;
+};
+
 USTRUCT(BlueprintType)
 struct FBehaviorData
 {
@@ -35,6 +127,10 @@ public:
 	UPROPERTY(EditAnywhere, BlueprintReadWrite)
 	TSubclassOf<UBehavior> Behavior;
 
+	// Used if Behavior is None: loaded asynchronously with the root Behavior, not selected until it's loaded.
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	TSoftClassPtr<UBehavior> SoftBehavior;
+
 	/*
 	Do Behavior N times per stage (reset after RefreshLevel).
 	MaxPerStage = 0 - unlimited times.
@@ -53,10 +149,11 @@ public:
 	UPROPERTY(EditAnywhere, BlueprintReadWrite)
 	int32 MaxRandRepeat = 0;
 
-	UPROPERTY(BlueprintReadOnly)
+	// Runtime counters are kept per Base instance now, kept so saved data and Blueprint pins still load. Always 0.
+	UPROPERTY(BlueprintReadOnly, meta = (DeprecatedProperty, DeprecationMessage = "Use UBehavior::GetPerStageCount."))
 	int32 CurrentPerStage = 0;
-	
-	UPROPERTY(BlueprintReadOnly)
+
+	UPROPERTY(BlueprintReadOnly, meta = (DeprecatedProperty, DeprecationMessage = "Use UBehavior::GetCooldownRemaining."))
 	float CurrentCooldown = 0.f;
 
 	FBehaviorData() {};
@@ -87,12 +184,52 @@ public:
 	UPROPERTY(EditAnywhere, BlueprintReadOnly)
 	uint8 Priority = 127;
 
-	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = Base, meta = (EditCondition = "Type==EBehaviorType::BT_Base"))
+	/**
+	 * Config of the class, read from the class defaults through FBehaviorSelectionTable.
+	 * Instances don't keep a copy (it's emptied in PostInitProperties), Blueprints read it through GetBehaviors.
+	 * Entries keep this order at runtime (indices of GetCooldownRemaining, GetPerStageCount), they are no longer sorted by RandomWeight.
+	 */
+	UPROPERTY(EditDefaultsOnly, BlueprintGetter = GetBehaviors, Category = Base, meta = (EditCondition = "Type==EBehaviorType::BT_Base"))
 	TArray<FBehaviorData> Behaviors;
 
+	// Behaviors shared through a data asset, used instead of the Behaviors array.
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = Base, meta = (EditCondition = "Type==EBehaviorType::BT_Base"))
+	class UBehaviorSet* BehaviorSet = nullptr;
+
+	// Seed of the random stream used by Base selection (0 - next seed of UBehaviorSubsystem).
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = Base, meta = (EditCondition = "Type==EBehaviorType::BT_Base"))
+	int32 RandomSeed = 0;
+
+	/**
+	 * Tick on demand: the Behavior is not ticked while it only waits for timers or delegates.
+	 * It is woken by RunBehavior (queue), SetIsInterrupted(false), a finished child, an expired cooldown or WakeBehavior.
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = Tick)
+	bool bTickOnDemand = false;
+
+	/**
+	 * Max number of finished Behaviors of this class kept for reuse by RunBehavior (0 - not pooled, the default).
+	 * Opt in only if nothing keeps references to Behaviors of this class after they finish.
+	 */
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category = Pool)
+	int32 PoolSize = 0;
+
+	// Soft classes this Behavior runs with RunBehaviorSoft, loaded with the root Behavior.
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category = Loading)
+	TArray<TSoftClassPtr<UBehavior>> PreloadClasses;
+
+	// Max number of Behaviors waiting for this one (see Priority).
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = Queue, meta = (ClampMin = "1"))
+	int32 MaxQueueSize = 4;
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = Queue)
+	EBehaviorQueueOverflow QueueOverflow = EBehaviorQueueOverflow::DropLowest;
+
+	// Ordered by Priority, FIFO within the same Priority.
 	UPROPERTY()
-	UBehavior* TaskQueue;
+	TArray<FBehaviorQueueEntry> TaskQueue;
 
+	// This Behavior holds an interrupt lock (see SetIsInterrupted).
 	UPROPERTY()
 	bool bIsInterrupted;
 
@@ -104,9 +241,18 @@ public:
 
 public:
 	UBehavior(const FObjectInitializer& ObjectInitializer);
+
+	virtual void PostInitProperties() override;
 	virtual void TickTask(float DeltaTime) override;
+	// Queue, finish and cooldown logic. Called by UBehaviorSubsystem (or TickTask if there is no subsystem).
+	void TickBehavior(float DeltaTime, bool bDispatchBehTick);
+	// Reset runtime state to class defaults before the Behavior is reused by UBehaviorPool.
+	virtual void ResetBehavior();
+	// Copy the payload of the request that created this Behavior.
+	virtual void ApplyRequest(const FBehaviorRequest& Request) {};
 	virtual void Activate() override;
 	virtual void OnDestroy(bool bInOwnerFinished) override;
+	virtual void InitTask(IGameplayTaskOwnerInterface& InTaskOwner, uint8 InPriority) override;
 
 public: // Blueprints
 	// Called when the task starts
@@ -117,8 +263,13 @@ public: // Blueprints
 	UFUNCTION(BlueprintImplementableEvent, DisplayName = "BehTick", Category = Behavior)
 	void BehTick(float DeltaTime);
 
-	// For current Behavior
+	// For current Behavior. FailedCode is compared by FName, see BehaviorCodes for the built-in ones.
 	UFUNCTION(BlueprintNativeEvent, Category = Behavior)
+	void OnBehaviorFinishedName(EBehaviorResult Result, FName FailedCode);
+	virtual void OnBehaviorFinishedName_Implementation(EBehaviorResult Result, FName FailedCode);
+
+	// String version for old Blueprints, called by OnBehaviorFinishedName only if a Blueprint implements it.
+	UFUNCTION(BlueprintNativeEvent, Category = Behavior, meta = (DeprecatedFunction, DeprecationMessage = "Use OnBehaviorFinishedName, FailedCode is an FName."))
 	void OnBehaviorFinished(EBehaviorResult Result, const FString& FailedCode);
 	virtual void OnBehaviorFinished_Implementation(EBehaviorResult Result, const FString& FailedCode) {};
 
@@ -129,6 +280,11 @@ public: // Blueprints
 
 	// Child Behavior has finished.
 	UFUNCTION(BlueprintNativeEvent, Category = Behavior)
+	void OnChildBehaviorFinishedName(TSubclassOf<UBehavior> Behavior, EBehaviorResult Result, FName FailedCode);
+	virtual void OnChildBehaviorFinishedName_Implementation(TSubclassOf<UBehavior> Behavior, EBehaviorResult Result, FName FailedCode);
+
+	// String version for old Blueprints, called by OnChildBehaviorFinishedName only if a Blueprint implements it.
+	UFUNCTION(BlueprintNativeEvent, Category = Behavior, meta = (DeprecatedFunction, DeprecationMessage = "Use OnChildBehaviorFinishedName, FailedCode is an FName."))
 	void OnChildBehaviorFinished(TSubclassOf<UBehavior> Behavior, EBehaviorResult Result, const FString& FailedCode);
 	virtual void OnChildBehaviorFinished_Implementation(TSubclassOf<UBehavior> Behavior, EBehaviorResult Result, const FString& FailedCode) {};
 
@@ -140,37 +296,95 @@ public:
 	UFUNCTION(BlueprintCallable, Category = Behavior)
 	UBehavior* RunBehavior(TSubclassOf<UBehavior> Behavior, bool bReady = true);
 
+	// RunBehavior if the class is loaded (returns it), otherwise it's loaded asynchronously and run when it's loaded (returns None).
 	UFUNCTION(BlueprintCallable, Category = Behavior)
-	void FinishBehavior(TEnumAsByte<EBehaviorResult> Result, const FString& FailedCode = "");
+	UBehavior* RunBehaviorSoft(TSoftClassPtr<UBehavior> Behavior, bool bReady = true);
 
+	/**
+	 * Start the requested Behavior now (returns it) or queue the request (returns None).
+	 * The Behavior is created only when it starts, ApplyRequest copies the payload before it's activated.
+	 */
+	UBehavior* RunBehaviorRequest(const FBehaviorRequest& Request);
+
+	/**
+	 * Put a Behavior in the queue without creating it, it's created and started when dequeued.
+	 * Returns false if the queue rejected it (see QueueOverflow).
+	 */
+	UFUNCTION(BlueprintCallable, Category = Behavior)
+	bool QueueBehavior(TSubclassOf<UBehavior> Behavior);
+
+	// FailedCode is compared by FName, see BehaviorCodes for the built-in ones.
+	UFUNCTION(BlueprintCallable, Category = Behavior)
+	void FinishBehavior(TEnumAsByte<EBehaviorResult> Result, FName FailedCode = NAME_None);
+
+	// FinishBehavior with a string FailedCode, for old Blueprints.
+	UFUNCTION(BlueprintCallable, Category = Behavior, DisplayName = "Finish Behavior (String)")
+	void FinishBehaviorString(TEnumAsByte<EBehaviorResult> Result, const FString& FailedCode) { FinishBehavior(Result, FName(*FailedCode)); };
+
+	/**
+	 * Take (or release) the interrupt lock of this Behavior: it and its parents can't finish until every lock below them is released.
+	 * Locks are counted on the first Behavior, so several interrupted children nest correctly.
+	 */
 	UFUNCTION(BlueprintCallable, Category = Behavior)
 	void SetIsInterrupted(bool IsInterrupted);
 
+	// This Behavior or one of its children holds an interrupt lock.
 	UFUNCTION(BlueprintPure, Category = Behavior)
-	bool IsInterrupted() const { return bIsInterrupted; };
+	bool IsInterrupted() const { return (InterruptRoot ? InterruptRoot : this)->DeepestInterrupt >= Depth; };
+
+	// Resume ticking of a sleeping Behavior (see bTickOnDemand).
+	UFUNCTION(BlueprintCallable, Category = Behavior)
+	void WakeBehavior();
+
+	UFUNCTION(BlueprintPure, Category = Behavior)
+	bool IsSleeping() const { return bSleeping; };
 
 	UFUNCTION(BlueprintCallable, Category = Behavior)
 	TArray<FString> GetDebugHierarchi();
 
 	// Get reference to parent Behavior
 	UFUNCTION(BlueprintPure, Category = Behavior)
-	UBehavior* GetParentBehavior();
+	UBehavior* GetParentBehavior() const { return IsValid(ParentBehavior) ? ParentBehavior : nullptr; };
 
 	// Get reference to child Behavior
 	UFUNCTION(BlueprintPure, Category = Behavior)
-	UBehavior* GetChildBehavior();
+	UBehavior* GetChildBehavior() const { return IsValid(ActiveChild) ? ActiveChild : nullptr; };
+
+	// Returns the parent Behavior, or this one if it's the first Behavior of the tasks component. BT_Base Behaviors run on it.
+	UFUNCTION(BlueprintPure, Category = Behavior)
+	UBehavior* GetBehaviorOwner() const { return IsValid(ParentBehavior) ? ParentBehavior : RootBehavior == this ? RootBehavior : nullptr; };
 
 	// Returns the first Behavior (for example, if state is "BehMain -> BehAction -> BehAnim", the function will return a reference to BehMain).
 	UFUNCTION(BlueprintPure, Category = Behavior)
-	UBehavior* GetBehaviorOwner();
+	UBehavior* GetRootBehavior() const { return IsValid(RootBehavior) ? RootBehavior : nullptr; };
 
 	// Returns the last Behavior (for example, if state is "BehMain -> BehAction -> BehAnim", the function will return a reference to BehAnim).
 	UFUNCTION(BlueprintCallable)
-	UBehavior* GetLastBehavior();
+	UBehavior* GetLastBehavior() { return IsValid(LastBehavior) ? LastBehavior : this; };
+
+	// Number of parents (0 for the first Behavior).
+	UFUNCTION(BlueprintPure, Category = Behavior)
+	int32 GetBehaviorDepth() const { return Depth; };
 
-	// Get the next task
+	// LOD band of the chain (0 - full tick rate, N - Bands[N - 1]).
+	UFUNCTION(BlueprintPure, Category = Behavior)
+	int32 GetLODLevel() const { return (InterruptRoot ? InterruptRoot : this)->LODLevel; };
+
+	// Tick LOD by distance to the nearest player, call it on the first Behavior of a chain before activation.
+	UFUNCTION(BlueprintCallable, Category = Behavior)
+	void SetLODSettings(const FBehaviorLODSettings& Settings);
+
+	// Base tasks of the chain don't select while the agent is in a band with bFreezeSelection.
+	UFUNCTION(BlueprintPure, Category = Behavior)
+	bool IsSelectionFrozen() const;
+
+	// Get the next task (None if it's not created yet, see QueueBehavior)
 	UFUNCTION(BlueprintCallable)
-	UBehavior* GetBehaviorInQueue() { return TaskQueue; };
+	UBehavior* GetBehaviorInQueue() { return TaskQueue.Num() > 0 ? TaskQueue[0].Behavior : nullptr; };
+
+	// Number of Behaviors waiting in the queue.
+	UFUNCTION(BlueprintPure, Category = Behavior)
+	int32 GetQueueDepth() const { return TaskQueue.Num(); };
 
 	UFUNCTION(BlueprintPure, DisplayName = "IsOwnedByTasksComponent", Category = Behavior)
 	bool BehaviorIsOwnedByTasksComponent() const { return IsOwnedByTasksComponent(); };
@@ -182,6 +396,17 @@ public:
 	UFUNCTION(BlueprintCallable, Category = Behavior)
 	TArray<UBehavior*> GetParallelBehaviors();
 
+	// Fill OutBehaviors with parallel Behaviors of this class (all of them if Class is None).
+	UFUNCTION(BlueprintCallable, Category = Behavior)
+	void GetParallelBehaviorsOfClass(TSubclassOf<UBehavior> Class, TArray<UBehavior*>& OutBehaviors);
+
+	// First parallel Behavior of this class.
+	UFUNCTION(BlueprintPure, Category = Behavior)
+	UBehavior* FindParallelBehavior(TSubclassOf<UBehavior> Class);
+
+	// Parallel Behaviors of our UGameplayTasksComponent, without copying.
+	TArrayView<UBehavior* const> GetParallelBehaviorsView() const;
+
 	UFUNCTION(BlueprintCallable, Category = Behavior)
 	AAIController* GetAIController();
 
@@ -192,11 +417,13 @@ public:
 	void BehDelay(FTimerHandle& TimerHandle, TLambda&& Lambda, float DelayTime)
 	{
 		TWeakObjectPtr<UBehavior> WeakThis(this);
+		const uint32 Generation = PoolGeneration;
 		GetWorld()->GetTimerManager().SetTimer(
 			TimerHandle,
-			[WeakThis, Lambda = std::forward<TLambda>(Lambda)]()
+			[WeakThis, Generation, Lambda = std::forward<TLambda>(Lambda)]()
 			{
-				if (WeakThis.IsValid() && WeakThis.Get()->IsBehaviorValid())
+				// Generation: the Behavior could be finished and reused by the pool.
+				if (WeakThis.IsValid() && WeakThis.Get()->IsBehaviorValid() && WeakThis.Get()->PoolGeneration == Generation)
 				{
 					Lambda();
 				}
@@ -206,6 +433,34 @@ public:
 		);
 	}
 
+	// Remaining cooldown of Behaviors[Index].
+	UFUNCTION(BlueprintPure, Category = Behavior)
+	float GetCooldownRemaining(int32 Index) const;
+
+	// Number of times Behaviors[Index] was selected in this stage.
+	UFUNCTION(BlueprintPure, Category = Behavior)
+	int32 GetPerStageCount(int32 Index) const;
+
+	// Number of Behaviors of BehaviorSet, or of the Behaviors array without it.
+	UFUNCTION(BlueprintPure, Category = Behavior)
+	int32 GetNumBehaviors() const;
+
+	// Behaviors of the class defaults (a copy, C++ can read GetDefaultObject<UBehavior>()->Behaviors).
+	UFUNCTION(BlueprintGetter)
+	TArray<FBehaviorData> GetBehaviors() const { return GetClass()->GetDefaultObject<UBehavior>()->Behaviors; };
+
+	// World time when some Behavior of this Base task can be selected (Max float if every Behavior reached MaxPerStage).
+	UFUNCTION(BlueprintPure, Category = Behavior)
+	float GetNextEligibleTime() const;
+
+	// Reset MaxPerStage counters of the Base tasks of our agent (UBehaviorSubsystem::RefreshLevel for the whole world).
+	UFUNCTION(BlueprintCallable, Category = Behavior)
+	void RefreshLevel();
+
+	// Restart the random stream of Base selection, for reproducible results.
+	UFUNCTION(BlueprintCallable, Category = Behavior)
+	void SetRandomSeed(int32 Seed);
+
 	UFUNCTION(BlueprintCallable)
 	void SetUsedActor(AActor* ActorToUse) { UsedActor = ActorToUse; };
 
@@ -215,18 +470,131 @@ public:
 
 private:
 	void SelectBehavior();
-	bool CanExecuteBehavior(const FBehaviorData& Behavior);
+	// Game thread checks before PrepareSelection, initializes the selector.
+	bool CanSelectBehavior();
+	/**
+	 * Data phase of SelectBehavior: cooldowns, eligibility and the weighted pick.
+	 * Touches only this Behavior (no UObjects are created), so UBehaviorSubsystem runs it for many Bases in parallel.
+	 */
+	FBehaviorSelectionDecision PrepareSelection(float Now);
+	// Game thread phase: run the selected Behavior.
+	void ApplySelection(const FBehaviorSelectionDecision& Decision);
+	bool CanExecuteBehavior(int32 Index) const;
+	void InitSelector();
+	void UpdateEligibility(int32 Index);
+	void StartCooldown(int32 Index);
+	void ExpireCooldowns(float Now);
+	float GetNextEligibleTimeAt(float Now) const;
+	// Reset per-stage counters if the world or agent stage changed since the last check.
+	void SyncStage();
+	// Update the eligibility of soft entries if classes were loaded since the last check (bForce - check now), request the missing ones.
+	void SyncLoadedClasses(bool bForce = false);
+	// Wake up (tick on demand) when the next cooldown ends.
+	void ScheduleCooldownWake();
+	// A queued selection didn't start a child, make sure a sleeping Base is woken later.
+	void OnSelectionDropped();
+	// Repeat the selected Behavior or start its cooldown, after the child selected by this Base finished.
+	void ContinueBase();
+
+	FBehaviorSelector Selector;
+	FBehaviorBaseState BaseState;
+	uint32 StageEpoch = 0;
+	// Every Behavior reached MaxPerStage, woken by RefreshLevel.
+	bool bStageExhausted = false;
+	uint32 ClassLoadEpoch = 0;
+	FRandomStream RandomStream;
+	FBehaviorCooldownTimeline Cooldowns;
+	FTimerHandle CooldownTimerHandle;
+	// Something can change in TickBehavior, so we can't sleep.
+	bool HasPendingWork();
 
-	FBehaviorData LastSelected;
 	int32 RepeatCount = 0, MaxRandomRepeat = 0, SelectedIndex = 0;
 	bool bSelectingTask;
 
+	// Hierarchy, updated in InitTask/OnDestroy
+	UPROPERTY()
+	UBehavior* ParentBehavior;
+
+	UPROPERTY()
+	UBehavior* ActiveChild;
+
+	UPROPERTY()
+	UBehavior* RootBehavior;
+
+	UPROPERTY()
+	UBehavior* LastBehavior;
+
+	int32 Depth = 0;
+
+	// First Behavior of the chain, even if it's not owned by the UGameplayTasksComponent.
+	UPROPERTY()
+	UBehavior* InterruptRoot;
+
+	// Interrupt locks of the chain, only used on InterruptRoot: number of locks held at each depth.
+	TArray<uint16, TInlineAllocator<8>> InterruptLocks;
+	int32 DeepestInterrupt = INDEX_NONE;
+
+	void AddInterruptLock(int32 LockDepth);
+	// Returns the depth of the deepest lock left.
+	int32 RemoveInterruptLock(int32 LockDepth);
+
+	// Refresh LastBehavior of this Behavior and the parents that lead to it.
+	void UpdateLastBehavior();
+
+	friend class UBehaviorSubsystem;
+	// EndTask if FinishBehavior was called while we were interrupted.
+	void FlushPendingFinish();
+	class UBehaviorSubsystem* BehaviorSubsystem = nullptr;
+	int32 TickBucket = INDEX_NONE, TickSlot = INDEX_NONE;
+	bool bSleeping = false;
+	bool bInParallelIndex = false;
+	// Waiting in the selection queue of UBehaviorSubsystem.
+	bool bSelectionQueued = false;
+
+	// LOD state, only used on the first Behavior of the chain. Settings are shared by the subsystem.
+	void UpdateLOD(float DeltaTime, const TArray<FVector>& ViewLocations);
+	TSharedPtr<const FBehaviorLODSettings> LODSettings;
+	int32 LODLevel = 0;
+	float LODAccumulatedTime = 0.f;
+	float LODDeltaTime = 0.f;
+	bool bLODTick = true;
+	bool bLODRegistered = false;
+	uint32 PoolGeneration = 0;
+	// Released to UBehaviorPool, until it's acquired again.
+	bool bInPool = false;
+	friend class UBehaviorPool;
+	// Dynamic delegates of the agent bound to us would call the next user of a pooled Behavior.
+	void UnbindAgentDelegates();
+
+	// Costs one branch while Behavior.Trace is off.
+	FORCEINLINE void TraceEvent(EBehaviorTraceEvent Event, uint8 Result = FBehaviorTrace::NoResult, FName FailedCode = NAME_None) const
+	{
+		if (UNLIKELY(FBehaviorTrace::IsEnabled()) && BehaviorSubsystem)
+			RecordTraceEvent(Event, Result, FailedCode);
+	}
+	void RecordTraceEvent(EBehaviorTraceEvent Event, uint8 Result, FName FailedCode) const;
+
+	class UBehaviorPool* GetPool() const;
+	// Get rid of a Behavior that was never initialized.
+	void DiscardBehavior(UBehavior* Behavior);
+
+	// A new Behavior of this Type and Priority has to wait in the queue.
+	bool ShouldQueue(EBehaviorType NewType, uint8 NewPriority) const;
+
+	// Insert by priority, applying QueueOverflow. Rejected or dropped Behaviors are discarded.
+	bool PushQueue(const FBehaviorQueueEntry& Entry);
+	void DiscardQueueEntry(const FBehaviorQueueEntry& Entry);
+	void ClearQueue();
+	void DequeueBehavior();
+
 	TEnumAsByte<EBehaviorResult> FinishResult = BR_Skipped;
-	FString FinishFailedCode;
+	FName FinishFailedCode;
 	bool bOwnedByBase;
 	bool m_bNeedToFinish;
 
 protected:
+	// Null if the world has no subsystem (the Behavior is ticked by its UGameplayTasksComponent).
+	UBehaviorSubsystem* GetBehaviorSubsystem() const { return BehaviorSubsystem; };
 
 	template<typename T>
 	FString EnumToString(const FString& enumName, const T value)
@@ -236,13 +604,18 @@ protected:
 	}
 
 public:
-	// Move to Location implementation.
+	// Move to Location implementation. A running BehMove child is retargeted instead of being replaced.
 	UFUNCTION(BlueprintCallable)
 	void RunBehMove(FVector TargetLocation, float AcceptanceRadius = 10.f);
 
+	// None if BehAnim has to wait in the queue, it's created when dequeued.
 	UFUNCTION(BlueprintCallable)
 	UBehAnim* RunBehAnim(UAnimSequenceBase* Animation, bool bLooping, bool bResetPose = true);
 
+	// Play Animation in a slot of the Animation Blueprint, the Behavior finishes when it blends out.
+	UFUNCTION(BlueprintCallable)
+	UBehAnim* RunBehAnimSlot(UAnimSequenceBase* Animation, FName SlotName, float PlayRate = 1.f, bool bLooping = false);
+
 	/*
 	* From HNCODE
 	// Only in C++, because using it in blueprints is dangerous and unnecessary.
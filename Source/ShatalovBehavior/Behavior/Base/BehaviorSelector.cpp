@@ -0,0 +1,161 @@
+// (c) XenFFly
+
+#include "BehaviorSelector.h"
+
+#include "Behavior.h"
+#include "BehaviorSet.h"
+
+FBehaviorSelectionTable::FBehaviorSelectionTable(const TArray<FBehaviorData>& Behaviors)
+{
+	const int32 Num = Behaviors.Num();
+	Classes.SetNumUninitialized(Num);
+	SoftClasses.SetNum(Num);
+	MaxPerStage.SetNumUninitialized(Num);
+	Cooldowns.SetNumUninitialized(Num);
+	MaxRandRepeat.SetNumUninitialized(Num);
+	Weights.SetNumUninitialized(Num);
+	Tree.SetNumZeroed(Num + 1);
+
+	for (int32 i = 0; i < Num; i++)
+	{
+		Classes[i] = Behaviors[i].Behavior;
+		if (!Classes[i] && !Behaviors[i].SoftBehavior.IsNull())
+		{
+			SoftClasses[i] = Behaviors[i].SoftBehavior;
+			NumSoftClasses++;
+		}
+		MaxPerStage[i] = Behaviors[i].MaxPerStage;
+		Cooldowns[i] = Behaviors[i].Cooldown;
+		MaxRandRepeat[i] = Behaviors[i].MaxRandRepeat;
+
+		Weights[i] = FMath::Max(Behaviors[i].RandomWeight, 0.f);
+		TotalWeight += Weights[i];
+
+		// Linear Fenwick build
+		const int32 Node = i + 1;
+		Tree[Node] += Weights[i];
+		const int32 Parent = Node + (Node & -Node);
+		if (Parent <= Num)
+			Tree[Parent] += Tree[Node];
+	}
+
+	HighestBit = Num > 0 ? 1 << FMath::FloorLog2(Num) : 0;
+}
+
+FBehaviorSelectionTable::FBehaviorSelectionTable(const FBehaviorSetCompiled& Set)
+	: MaxPerStage(Set.MaxPerStage), Cooldowns(Set.Cooldowns), MaxRandRepeat(Set.MaxRandRepeat)
+{
+	const int32 Num = Set.Num();
+	Classes.SetNumZeroed(Num);
+	SoftClasses.SetNum(Num);
+	Weights.SetNumUninitialized(Num);
+	Tree.SetNumZeroed(Num + 1);
+
+	for (int32 i = 0; i < Num; i++)
+	{
+		const int32 ClassIndex = Set.ClassIndices[i];
+		if (Set.Classes.IsValidIndex(ClassIndex))
+			Classes[i] = Set.Classes[ClassIndex];
+		else if (Set.SoftClasses.IsValidIndex(-ClassIndex - 1))
+		{
+			SoftClasses[i] = Set.SoftClasses[-ClassIndex - 1];
+			NumSoftClasses++;
+		}
+
+		// Node covers (Node - lowbit, Node]
+		const int32 Node = i + 1;
+		Weights[i] = Set.PrefixWeights[Node] - Set.PrefixWeights[i];
+		Tree[Node] = Set.PrefixWeights[Node] - Set.PrefixWeights[Node - (Node & -Node)];
+	}
+
+	TotalWeight = Set.PrefixWeights[Num];
+	HighestBit = Num > 0 ? 1 << FMath::FloorLog2(Num) : 0;
+}
+
+UClass* FBehaviorSelectionTable::GetClass(int32 Index) const
+{
+	return Classes[Index] ? Classes[Index] : SoftClasses[Index].Get();
+}
+
+void FBehaviorSelector::Init(const TSharedPtr<const FBehaviorSelectionTable>& InTable)
+{
+	Table = InTable;
+	Tree = Table->Tree;
+	Eligible.Init(true, Table->Num());
+	TotalWeight = Table->TotalWeight;
+	NumEligible = Table->Num();
+}
+
+void FBehaviorSelector::Reset()
+{
+	Table.Reset();
+	Tree.Reset();
+	Eligible.Empty();
+	TotalWeight = 0.0;
+	NumEligible = 0;
+}
+
+void FBehaviorSelector::SetEligible(int32 Index, bool bEligible)
+{
+	if (Eligible[Index] == bEligible)
+		return;
+
+	Eligible[Index] = bEligible;
+	NumEligible += bEligible ? 1 : -1;
+
+	if (NumEligible == Table->Num())
+	{
+		// Everything is eligible again, drop the accumulated rounding error.
+		Tree = Table->Tree;
+		TotalWeight = Table->TotalWeight;
+		return;
+	}
+
+	const double Delta = bEligible ? Table->Weights[Index] : -Table->Weights[Index];
+	for (int32 Node = Index + 1; Node < Tree.Num(); Node += Node & -Node)
+		Tree[Node] += Delta;
+
+	TotalWeight = NumEligible > 0 ? FMath::Max(TotalWeight + Delta, 0.0) : 0.0;
+}
+
+int32 FBehaviorSelector::Select(FRandomStream& Stream) const
+{
+	if (NumEligible == 0)
+		return INDEX_NONE;
+
+	// Only zero weight entries are left: any of them, like when every entry has the same weight.
+	if (TotalWeight <= 0.0)
+	{
+		int32 Skip = Stream.RandHelper(NumEligible);
+		for (TConstSetBitIterator<> It(Eligible); It; ++It)
+			if (Skip-- == 0)
+				return It.GetIndex();
+		return INDEX_NONE;
+	}
+
+	// (0, TotalWeight], so zero weight entries are never selected.
+	double Remaining = (1.0 - Stream.GetFraction()) * TotalWeight;
+
+	// Smallest index with prefix sum >= Remaining
+	int32 Position = 0;
+	for (int32 Step = Table->HighestBit; Step > 0; Step >>= 1)
+	{
+		const int32 Next = Position + Step;
+		if (Next < Tree.Num() && Tree[Next] < Remaining)
+		{
+			Position = Next;
+			Remaining -= Tree[Next];
+		}
+	}
+
+	// Rounding can put us past the last eligible entry.
+	if (Position >= Table->Num() || !Eligible[Position] || Table->Weights[Position] <= 0.0)
+	{
+		for (int32 i = Table->Num() - 1; i >= 0; i--)
+			if (Eligible[i] && Table->Weights[i] > 0.0)
+				return i;
+		return INDEX_NONE;
+	}
+
+	return Position;
+}
@@ -0,0 +1,144 @@
+// (c) XenFFly
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "UObject/SoftObjectPtr.h"
+
+struct FBehaviorData;
+struct FBehaviorSetCompiled;
+class UBehavior;
+
+/**
+ * Immutable config of a Base Behaviors array (SoA, same order) with RandomWeight as a Fenwick tree.
+ * Built once per class and shared by its instances, the classes are referenced by the Behaviors array it was built from
+ * (loaded soft classes by UBehaviorClassLoader).
+ */
+struct SHATALOVBEHAVIOR_API FBehaviorSelectionTable
+{
+	FBehaviorSelectionTable() {};
+	explicit FBehaviorSelectionTable(const TArray<FBehaviorData>& Behaviors);
+	// From the flat layout of a UBehaviorSet, the tree is built from the prefix sums.
+	explicit FBehaviorSelectionTable(const FBehaviorSetCompiled& Set);
+
+	int32 Num() const { return Weights.Num(); };
+
+	// Game thread only, soft classes are resolved. Null if the class is not loaded.
+	UClass* GetClass(int32 Index) const;
+
+	TArray<UClass*> Classes;
+	// Entries without a hard class, loaded by UBehaviorClassLoader.
+	TArray<TSoftClassPtr<UBehavior>> SoftClasses;
+	int32 NumSoftClasses = 0;
+	TArray<int32> MaxPerStage;
+	TArray<float> Cooldowns;
+	TArray<int32> MaxRandRepeat;
+
+	TArray<double> Weights;
+	// 1-based Fenwick tree of Weights
+	TArray<double> Tree;
+	double TotalWeight = 0.0;
+	// Highest power of two <= Num(), for the tree descent.
+	int32 HighestBit = 0;
+};
+
+/**
+ * Weighted random selection over the eligible Behaviors of a Base task.
+ * Eligibility is updated incrementally (O(log n)), selection is O(log n) without heap allocation.
+ */
+struct SHATALOVBEHAVIOR_API FBehaviorSelector
+{
+	void Init(const TSharedPtr<const FBehaviorSelectionTable>& InTable);
+	void Reset();
+
+	bool IsInitialized() const { return Table.IsValid(); };
+	int32 Num() const { return Eligible.Num(); };
+	const FBehaviorSelectionTable& GetTable() const { return *Table; };
+
+	void SetEligible(int32 Index, bool bEligible);
+	bool IsEligible(int32 Index) const { return Eligible[Index]; };
+
+	// Index of the selected Behavior, INDEX_NONE if nothing is eligible. Uniform if every eligible entry has zero weight.
+	int32 Select(FRandomStream& Stream) const;
+
+	int32 GetNumEligible() const { return NumEligible; };
+	double GetTotalWeight() const { return TotalWeight; };
+
+private:
+	TSharedPtr<const FBehaviorSelectionTable> Table;
+	TArray<double> Tree;
+	TBitArray<> Eligible;
+	double TotalWeight = 0.0;
+	int32 NumEligible = 0;
+};
+
+// Runtime state of a Base task (SoA, indexed like its Behaviors), the config is read from FBehaviorSelectionTable.
+struct FBehaviorBaseState
+{
+	void Init(int32 Num)
+	{
+		CooldownEndTimes.Init(0.f, Num);
+		PerStage.Init(0, Num);
+		Unloaded.Init(false, Num);
+	}
+
+	void Reset()
+	{
+		CooldownEndTimes.Empty();
+		PerStage.Empty();
+		Unloaded.Empty();
+	}
+
+	int32 Num() const { return PerStage.Num(); };
+
+	// World time when the cooldown ends, 0 - not cooling down.
+	TArray<float> CooldownEndTimes;
+	// Number of selections in this stage.
+	TArray<int32> PerStage;
+	// Soft classes that are not loaded yet, they are not selected.
+	TBitArray<> Unloaded;
+};
+
+// Result of the data phase of a Base selection (UBehavior::PrepareSelection), applied on the game thread.
+struct FBehaviorSelectionDecision
+{
+	UBehavior* Base = nullptr;
+	// The Base can be finished and reused by the pool before the decision is applied.
+	uint32 PoolGeneration = 0;
+	int32 Index = INDEX_NONE;
+	int32 MaxRandRepeat = 0;
+	bool bZeroWeight = false;
+};
+
+// Cooldown expiries of a Base task as a min-heap, so only cooldowns that actually end are touched.
+struct SHATALOVBEHAVIOR_API FBehaviorCooldownTimeline
+{
+	struct FEntry
+	{
+		float EndTime;
+		int32 Index;
+
+		bool operator<(const FEntry& Other) const { return EndTime < Other.EndTime; };
+	};
+
+	void Start(int32 Index, float EndTime) { Heap.HeapPush({ EndTime, Index }); };
+	void Reset() { Heap.Reset(); };
+
+	bool IsEmpty() const { return Heap.Num() == 0; };
+	float GetNextEndTime() const { return Heap.Num() > 0 ? Heap.HeapTop().EndTime : TNumericLimits<float>::Max(); };
+
+	// Pop every entry ended before Now. OnExpired(Index, EndTime) must ignore restarted cooldowns.
+	template<typename TFunc>
+	void Expire(float Now, TFunc&& OnExpired)
+	{
+		while (Heap.Num() > 0 && Heap.HeapTop().EndTime <= Now)
+		{
+			FEntry Entry;
+			Heap.HeapPop(Entry, false);
+			OnExpired(Entry.Index, Entry.EndTime);
+		}
+	}
+
+private:
+	TArray<FEntry, TInlineAllocator<8>> Heap;
+};
@@ -0,0 +1,74 @@
+// (c) XenFFly
+
+#include "BehaviorSet.h"
+
+#include "BehaviorSelector.h"
+
+// Bump when FBehaviorSetCompiled changes, sets are compiled again when they are loaded in the editor.
+static constexpr int32 BehaviorSetVersion = 1;
+
+void UBehaviorSet::PostLoad()
+{
+	Super::PostLoad();
+
+#if WITH_EDITOR
+	if (Compiled.Version != BehaviorSetVersion)
+		Compile();
+#endif
+}
+
+void UBehaviorSet::PreSave(const ITargetPlatform* TargetPlatform)
+{
+	Super::PreSave(TargetPlatform);
+
+#if WITH_EDITOR
+	Compile();
+#endif
+}
+
+#if WITH_EDITOR
+void UBehaviorSet::PostEditChangeProperty(FPropertyChangedEvent& PropertyChangedEvent)
+{
+	Super::PostEditChangeProperty(PropertyChangedEvent);
+	Compile();
+}
+
+void UBehaviorSet::Compile()
+{
+	Compiled = FBehaviorSetCompiled();
+	Compiled.Version = BehaviorSetVersion;
+	Compiled.PrefixWeights.Reserve(Behaviors.Num() + 1);
+	Compiled.PrefixWeights.Add(0.0);
+
+	for (const FBehaviorData& Data : Behaviors)
+	{
+		// Hard classes win, like in a Behaviors array.
+		if (Data.Behavior || Data.SoftBehavior.IsNull())
+			Compiled.ClassIndices.Add(Compiled.Classes.AddUnique(Data.Behavior));
+		else Compiled.ClassIndices.Add(-Compiled.SoftClasses.AddUnique(Data.SoftBehavior) - 1);
+
+		Compiled.PrefixWeights.Add(Compiled.PrefixWeights.Last() + FMath::Max(Data.RandomWeight, 0.f));
+		Compiled.Cooldowns.Add(Data.Cooldown);
+		Compiled.MaxPerStage.Add(Data.MaxPerStage);
+		Compiled.MaxRandRepeat.Add(Data.MaxRandRepeat);
+	}
+
+	// Running Bases keep the table they were initialized with.
+	Table.Reset();
+}
+#endif
+
+TSharedPtr<const FBehaviorSelectionTable> UBehaviorSet::GetTable() const
+{
+	if (!Table.IsValid())
+	{
+		const int32 Num = Compiled.Num();
+		const bool bValid = Compiled.PrefixWeights.Num() == Num + 1 && Compiled.Cooldowns.Num() == Num &&
+			Compiled.MaxPerStage.Num() == Num && Compiled.MaxRandRepeat.Num() == Num;
+		if (!bValid)
+			UE_LOG(LogBehavior, Error, TEXT("Behavior set is not compiled, save it again: %s"), *GetPathName());
+
+		Table = bValid ? MakeShared<FBehaviorSelectionTable>(Compiled) : MakeShared<FBehaviorSelectionTable>();
+	}
+	return Table;
+}
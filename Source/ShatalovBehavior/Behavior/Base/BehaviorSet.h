@@ -0,0 +1,91 @@
+// (c) XenFFly
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Engine/DataAsset.h"
+#include "Behavior.h"
+#include "BehaviorSet.generated.h"
+
+struct FBehaviorSelectionTable;
+
+/**
+ * Flat layout of a behavior set, compiled from its Behaviors when the asset is saved or cooked.
+ * Each class is stored once, entries refer to it by index.
+ */
+USTRUCT()
+struct SHATALOVBEHAVIOR_API FBehaviorSetCompiled
+{
+	GENERATED_BODY()
+
+public:
+	UPROPERTY()
+	TArray<TSubclassOf<UBehavior>> Classes;
+
+	UPROPERTY()
+	TArray<TSoftClassPtr<UBehavior>> SoftClasses;
+
+	// Per entry: Classes[Index], or SoftClasses[-Index - 1] if it's negative.
+	UPROPERTY()
+	TArray<int32> ClassIndices;
+
+	// Num() + 1 sums of RandomWeight, PrefixWeights[i + 1] - PrefixWeights[i] is the weight of entry i.
+	UPROPERTY()
+	TArray<double> PrefixWeights;
+
+	UPROPERTY()
+	TArray<float> Cooldowns;
+
+	UPROPERTY()
+	TArray<int32> MaxPerStage;
+
+	UPROPERTY()
+	TArray<int32> MaxRandRepeat;
+
+	// Layout version, older layouts are compiled again on load.
+	UPROPERTY()
+	int32 Version = 0;
+
+	int32 Num() const { return ClassIndices.Num(); };
+};
+
+/**
+ * Behaviors of BT_Base tasks as a data asset, referenced by UBehavior::BehaviorSet instead of a Behaviors array per class.
+ * All Bases using the set share one read-only FBehaviorSelectionTable, and tuning it doesn't need a C++ or Blueprint change.
+ */
+UCLASS(BlueprintType)
+class SHATALOVBEHAVIOR_API UBehaviorSet : public UDataAsset
+{
+	GENERATED_BODY()
+
+public:
+#if WITH_EDITORONLY_DATA
+	// Source of the compiled layout, not cooked.
+	UPROPERTY(EditAnywhere, Category = Base)
+	TArray<FBehaviorData> Behaviors;
+#endif
+
+	virtual void PostLoad() override;
+	virtual void PreSave(const class ITargetPlatform* TargetPlatform) override;
+#if WITH_EDITOR
+	virtual void PostEditChangeProperty(FPropertyChangedEvent& PropertyChangedEvent) override;
+#endif
+
+	// Game thread, built from the compiled layout on first use.
+	TSharedPtr<const FBehaviorSelectionTable> GetTable() const;
+
+	const FBehaviorSetCompiled& GetCompiled() const { return Compiled; };
+
+	UFUNCTION(BlueprintPure, Category = Base)
+	int32 Num() const { return Compiled.Num(); };
+
+private:
+#if WITH_EDITOR
+	void Compile();
+#endif
+
+	UPROPERTY()
+	FBehaviorSetCompiled Compiled;
+
+	mutable TSharedPtr<const FBehaviorSelectionTable> Table;
+};
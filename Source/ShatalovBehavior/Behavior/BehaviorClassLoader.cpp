@@ -0,0 +1,156 @@
+// (c) XenFFly
+
+#include "BehaviorClassLoader.h"
+
+#include "BehaviorStats.h"
+#include "BehaviorSubsystem.h"
+#include "Base/Behavior.h"
+#include "Base/BehaviorSet.h"
+#include "HAL/IConsoleManager.h"
+
+static int32 GBehaviorPreloadClasses = 1;
+static FAutoConsoleVariableRef CVarBehaviorPreloadClasses(
+	TEXT("Behavior.PreloadClasses"),
+	GBehaviorPreloadClasses,
+	TEXT("Load the soft Behavior classes of a root Behavior when it's activated (0 - load them when they are needed)."));
+
+void UBehaviorClassLoader::Preload(UClass* RootClass)
+{
+	if (!GBehaviorPreloadClasses || !RootClass)
+		return;
+
+	bool bAlreadyPreloaded = false;
+	PreloadedRoots.Add(RootClass, &bAlreadyPreloaded);
+	if (bAlreadyPreloaded)
+		return;
+
+	TSet<UClass*> Visited;
+	TArray<FSoftObjectPath> Paths;
+	CollectPreloadSet(RootClass, Visited, Paths);
+	for (const FSoftObjectPath& Path : Paths)
+		Request(TSoftClassPtr<UBehavior>(Path));
+}
+
+void UBehaviorClassLoader::CollectPreloadSet(UClass* Class, TSet<UClass*>& Visited, TArray<FSoftObjectPath>& OutPaths) const
+{
+	bool bAlreadyVisited = false;
+	Visited.Add(Class, &bAlreadyVisited);
+	const UBehavior* Defaults = bAlreadyVisited ? nullptr : Cast<UBehavior>(Class->GetDefaultObject());
+	if (!Defaults)
+		return;
+
+	auto VisitSoft = [&](const TSoftClassPtr<UBehavior>& SoftClass)
+	{
+		if (SoftClass.IsNull())
+			return;
+		if (UClass* LoadedClass = SoftClass.Get())
+			CollectPreloadSet(LoadedClass, Visited, OutPaths);
+		else OutPaths.AddUnique(SoftClass.ToSoftObjectPath());
+	};
+
+	for (const FBehaviorData& Data : Defaults->Behaviors)
+	{
+		if (Data.Behavior)
+			CollectPreloadSet(Data.Behavior, Visited, OutPaths);
+		else VisitSoft(Data.SoftBehavior);
+	}
+	for (const TSoftClassPtr<UBehavior>& SoftClass : Defaults->PreloadClasses)
+		VisitSoft(SoftClass);
+
+	if (Defaults->BehaviorSet)
+	{
+		const FBehaviorSetCompiled& Set = Defaults->BehaviorSet->GetCompiled();
+		for (UClass* SetClass : Set.Classes)
+			if (SetClass)
+				CollectPreloadSet(SetClass, Visited, OutPaths);
+		for (const TSoftClassPtr<UBehavior>& SoftClass : Set.SoftClasses)
+			VisitSoft(SoftClass);
+	}
+}
+
+void UBehaviorClassLoader::Request(const TSoftClassPtr<UBehavior>& Class, TFunction<void(UClass*)>&& OnLoaded)
+{
+	if (Class.IsNull() || Class.Get())
+	{
+		if (OnLoaded)
+			OnLoaded(Class.Get());
+		return;
+	}
+
+	const FSoftObjectPath Path = Class.ToSoftObjectPath();
+	if (Failed.Contains(Path))
+	{
+		if (OnLoaded)
+			OnLoaded(nullptr);
+		return;
+	}
+
+	if (FPendingLoad* Load = Pending.Find(Path))
+	{
+		if (OnLoaded)
+			Load->Callbacks.Add(MoveTemp(OnLoaded));
+		return;
+	}
+
+	FPendingLoad& Load = Pending.Add(Path);
+	Load.StartTime = FPlatformTime::Seconds();
+	if (OnLoaded)
+		Load.Callbacks.Add(MoveTemp(OnLoaded));
+
+	// The delegate can be called inside RequestAsyncLoad, Load can't be used after it.
+	TSharedPtr<FStreamableHandle> Handle = StreamableManager.RequestAsyncLoad(Path, FStreamableDelegate::CreateUObject(this, &UBehaviorClassLoader::OnClassLoaded, Path));
+	if (FPendingLoad* Started = Pending.Find(Path))
+		Started->Handle = Handle;
+}
+
+void UBehaviorClassLoader::OnClassLoaded(FSoftObjectPath Path)
+{
+	FPendingLoad Load;
+	if (!Pending.RemoveAndCopyValue(Path, Load))
+		return;
+
+	UClass* Class = Cast<UClass>(Path.ResolveObject());
+	if (Class && Class->IsChildOf(UBehavior::StaticClass()))
+	{
+		const double LoadTime = FPlatformTime::Seconds() - Load.StartTime;
+		NumLoaded++;
+		TotalLoadTime += LoadTime;
+		MaxLoadTime = FMath::Max(MaxLoadTime, LoadTime);
+		INC_DWORD_STAT(STAT_BehaviorClassLoads);
+		SET_FLOAT_STAT(STAT_BehaviorClassLoadMs, LoadTime * 1000.0);
+		LoadedClasses.Add(Class);
+
+		// Soft classes of the loaded class
+		TSet<UClass*> Visited;
+		TArray<FSoftObjectPath> Paths;
+		CollectPreloadSet(Class, Visited, Paths);
+		for (const FSoftObjectPath& SoftPath : Paths)
+			Request(TSoftClassPtr<UBehavior>(SoftPath));
+	}
+	else
+	{
+		Class = nullptr;
+		Failed.Add(Path);
+		UE_LOG(LogBehavior, Warning, TEXT("Can't load Behavior class %s."), *Path.ToString());
+	}
+
+	LoadEpoch++;
+	for (TFunction<void(UClass*)>& Callback : Load.Callbacks)
+		Callback(Class);
+
+	// Bases without loaded entries sleep until something can be selected.
+	if (UBehaviorSubsystem* Subsystem = GetTypedOuter<UBehaviorSubsystem>())
+		Subsystem->WakeExhaustedBases();
+}
+
+void UBehaviorClassLoader::Empty()
+{
+	for (TPair<FSoftObjectPath, FPendingLoad>& Load : Pending)
+		if (Load.Value.Handle.IsValid())
+			Load.Value.Handle->CancelHandle();
+	Pending.Empty();
+	Failed.Empty();
+	LoadedClasses.Empty();
+	PreloadedRoots.Empty();
+	LoadEpoch++;
+}
@@ -0,0 +1,75 @@
+// (c) XenFFly
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "UObject/Object.h"
+#include "Engine/StreamableManager.h"
+#include "BehaviorClassLoader.generated.h"
+
+class UBehavior;
+
+/**
+ * Asynchronous loading of soft Behavior classes (FBehaviorData::SoftBehavior, UBehavior::PreloadClasses, RunBehaviorSoft).
+ * The preload set of a root Behavior class is every soft class reachable from it, it's requested when the root is activated.
+ * Loaded classes are kept until the world is destroyed.
+ */
+UCLASS()
+class SHATALOVBEHAVIOR_API UBehaviorClassLoader : public UObject
+{
+	GENERATED_BODY()
+
+public:
+	// Request the preload set of a root Behavior class (once per class).
+	void Preload(UClass* RootClass);
+
+	// Request a class, OnLoaded is called when it's loaded (at once if it already is, with nullptr if it can't be loaded).
+	void Request(const TSoftClassPtr<UBehavior>& Class, TFunction<void(UClass*)>&& OnLoaded = nullptr);
+
+	// Changes when requested classes are loaded, Base tasks compare it to recheck entries that were not loaded.
+	uint32 GetLoadEpoch() const { return LoadEpoch; };
+
+	void Empty();
+
+public: // Stats
+	UFUNCTION(BlueprintPure, Category = "Behavior|Loading")
+	int32 GetNumLoaded() const { return NumLoaded; };
+
+	UFUNCTION(BlueprintPure, Category = "Behavior|Loading")
+	int32 GetNumPending() const { return Pending.Num(); };
+
+	// Average and max time from the request of a class to its load, in seconds.
+	UFUNCTION(BlueprintPure, Category = "Behavior|Loading")
+	float GetAverageLoadTime() const { return NumLoaded > 0 ? (float)(TotalLoadTime / NumLoaded) : 0.f; };
+
+	UFUNCTION(BlueprintPure, Category = "Behavior|Loading")
+	float GetMaxLoadTime() const { return (float)MaxLoadTime; };
+
+private:
+	struct FPendingLoad
+	{
+		TSharedPtr<FStreamableHandle> Handle;
+		TArray<TFunction<void(UClass*)>, TInlineAllocator<1>> Callbacks;
+		double StartTime = 0.0;
+	};
+
+	// Soft classes referenced by Class and the loaded classes below it.
+	void CollectPreloadSet(UClass* Class, TSet<UClass*>& Visited, TArray<FSoftObjectPath>& OutPaths) const;
+	void OnClassLoaded(FSoftObjectPath Path);
+
+	FStreamableManager StreamableManager;
+
+	TMap<FSoftObjectPath, FPendingLoad> Pending;
+	// Not requested again.
+	TSet<FSoftObjectPath> Failed;
+
+	// Soft references don't keep the loaded classes.
+	UPROPERTY()
+	TArray<UClass*> LoadedClasses;
+	TSet<TWeakObjectPtr<UClass>> PreloadedRoots;
+
+	uint32 LoadEpoch = 0;
+	int32 NumLoaded = 0;
+	double TotalLoadTime = 0.0;
+	double MaxLoadTime = 0.0;
+};
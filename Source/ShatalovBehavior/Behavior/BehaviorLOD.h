@@ -0,0 +1,44 @@
+// (c) XenFFly
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "BehaviorLOD.generated.h"
+
+USTRUCT(BlueprintType)
+struct FBehaviorLODBand
+{
+	GENERATED_BODY()
+
+public:
+	// Distance to the nearest player from which this band is used.
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, meta = (ClampMin = "0"))
+	float Distance = 5000.f;
+
+	// The chain is ticked every TickInterval seconds with the accumulated DeltaTime (0 - every frame).
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, meta = (ClampMin = "0"))
+	float TickInterval = 0.5f;
+
+	// Base tasks of the chain don't select new Behaviors.
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	bool bFreezeSelection = false;
+};
+
+// Tick LOD of a Behavior chain, given to its first Behavior with UBehavior::SetLODSettings (see ABehaviorOwner::BehaviorLOD).
+USTRUCT(BlueprintType)
+struct FBehaviorLODSettings
+{
+	GENERATED_BODY()
+
+public:
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	bool bEnabled = false;
+
+	// From the nearest to the farthest.
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, meta = (EditCondition = "bEnabled"))
+	TArray<FBehaviorLODBand> Bands;
+
+	// A band is entered Hysteresis farther than its Distance and left Hysteresis closer.
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, meta = (EditCondition = "bEnabled", ClampMin = "0"))
+	float Hysteresis = 500.f;
+};
@@ -0,0 +1,273 @@
+// (c) XenFFly
+
+#include "BehaviorPathService.h"
+
+#include "AIController.h"
+#include "BehaviorStats.h"
+#include "Base/BehMove.h"
+#include "HAL/IConsoleManager.h"
+#include "NavigationSystem.h"
+#include "NavFilters/NavigationQueryFilter.h"
+#include "Navigation/PathFollowingComponent.h"
+
+static int32 GBehaviorPathService = 1;
+static FAutoConsoleVariableRef CVarBehaviorPathService(
+	TEXT("Behavior.PathService"),
+	GBehaviorPathService,
+	TEXT("BehMove finds paths through the shared path cache (0 - every BehMove runs its own MoveTo)."));
+
+static int32 GBehaviorPathBudget = 16;
+static FAutoConsoleVariableRef CVarBehaviorPathBudget(
+	TEXT("Behavior.PathBudget"),
+	GBehaviorPathBudget,
+	TEXT("Max number of async path queries started per frame (0 - unlimited)."));
+
+static float GBehaviorPathCacheLifetime = 5.f;
+static FAutoConsoleVariableRef CVarBehaviorPathCacheLifetime(
+	TEXT("Behavior.PathCacheLifetime"),
+	GBehaviorPathCacheLifetime,
+	TEXT("Seconds a found path is reused."));
+
+static int32 GBehaviorPathCacheSize = 1024;
+static FAutoConsoleVariableRef CVarBehaviorPathCacheSize(
+	TEXT("Behavior.PathCacheSize"),
+	GBehaviorPathCacheSize,
+	TEXT("Max number of cached paths."));
+
+static float GBehaviorPathGoalTolerance = 10.f;
+static FAutoConsoleVariableRef CVarBehaviorPathGoalTolerance(
+	TEXT("Behavior.PathGoalTolerance"),
+	GBehaviorPathGoalTolerance,
+	TEXT("Size of the goal cell, goals in the same cell share paths."));
+
+void UBehaviorPathService::Init()
+{
+	UNavigationSystemV1* NavSys = FNavigationSystem::GetCurrent<UNavigationSystemV1>(GetWorld());
+	if (NavSys && !NavSys->OnNavigationGenerationFinishedDelegate.IsAlreadyBound(this, &UBehaviorPathService::OnNavigationGenerated))
+		NavSys->OnNavigationGenerationFinishedDelegate.AddDynamic(this, &UBehaviorPathService::OnNavigationGenerated);
+}
+
+uint32 UBehaviorPathService::RequestPath(UBehMove* Move, AAIController* Controller, const FVector& Goal, TSubclassOf<UNavigationQueryFilter> FilterClass, FNavPathSharedPtr& OutPath)
+{
+	OutPath.Reset();
+	if (!GBehaviorPathService || !Move || !Controller || !Controller->GetPawn())
+		return 0;
+
+	UNavigationSystemV1* NavSys = FNavigationSystem::GetCurrent<UNavigationSystemV1>(GetWorld());
+	if (!NavSys)
+		return 0;
+
+	// The navigation system can be created after the subsystem.
+	Init();
+
+	const FNavAgentProperties& AgentProperties = Controller->GetNavAgentPropertiesRef();
+	const FVector Start = Controller->GetNavAgentLocation();
+	const ANavigationData* NavData = NavSys->GetNavDataForProps(AgentProperties, Start);
+	if (!NavData)
+		return 0;
+
+	const FSharedConstNavQueryFilter Filter = UNavigationQueryFilter::GetQueryFilter(*NavData, Controller, FilterClass);
+	FNavLocation StartLocation;
+	if (!NavSys->ProjectPointToNavigation(Start, StartLocation, INVALID_NAVEXTENT, NavData, Filter))
+		return 0;
+
+	const float Tolerance = FMath::Max(GBehaviorPathGoalTolerance, 1.f);
+	FBehaviorPathKey Key;
+	Key.StartPoly = StartLocation.NodeRef;
+	Key.GoalCell = FIntVector(FMath::FloorToInt(Goal.X / Tolerance), FMath::FloorToInt(Goal.Y / Tolerance), FMath::FloorToInt(Goal.Z / Tolerance));
+	Key.NavData = NavData;
+	Key.FilterClass = *FilterClass;
+
+	const uint32 Ticket = ++NextTicket != 0 ? NextTicket : ++NextTicket;
+	const double Now = FPlatformTime::Seconds();
+
+	if (const FCachedPath* Cached = Cache.Find(Key))
+	{
+		if (Cached->Path->IsValid() && Cached->Path->IsUpToDate() && Now - Cached->Time < GBehaviorPathCacheLifetime)
+		{
+			Hits++;
+			INC_DWORD_STAT(STAT_BehaviorPathHits);
+			OutPath = Cached->Path;
+			return Ticket;
+		}
+		Cache.Remove(Key);
+	}
+
+	// The same path is already being found.
+	if (FPendingQuery* Query = Pending.Find(Key))
+	{
+		Hits++;
+		INC_DWORD_STAT(STAT_BehaviorPathHits);
+		Query->Waiters.Add({ Move, Ticket });
+		return Ticket;
+	}
+
+	Misses++;
+	INC_DWORD_STAT(STAT_BehaviorPathMisses);
+
+	FPendingQuery& Query = Pending.Add(Key);
+	Query.Waiters.Add({ Move, Ticket });
+	Query.Start = StartLocation.Location;
+	Query.Goal = Goal;
+	Query.NavData = NavData;
+	Query.AgentProperties = AgentProperties;
+	Query.Filter = Filter;
+	QueryQueue.Add(Key);
+	return Ticket;
+}
+
+void UBehaviorPathService::RegisterMove(UBehMove* Move, AAIController* Controller, FAIRequestID RequestID)
+{
+	UPathFollowingComponent* PathFollowing = Controller ? Controller->GetPathFollowingComponent() : nullptr;
+	if (!PathFollowing || !RequestID.IsValid())
+		return;
+
+	bool bAlreadyBound = false;
+	BoundComponents.Add(PathFollowing, &bAlreadyBound);
+	if (!bAlreadyBound)
+		PathFollowing->OnRequestFinished.AddUObject(this, &UBehaviorPathService::OnMoveRequestFinished);
+
+	Moves.Add(RequestID.GetID(), Move);
+}
+
+void UBehaviorPathService::UnregisterMove(FAIRequestID RequestID)
+{
+	if (RequestID.IsValid())
+		Moves.Remove(RequestID.GetID());
+}
+
+void UBehaviorPathService::OnMoveRequestFinished(FAIRequestID RequestID, const FPathFollowingResult& Result)
+{
+	TWeakObjectPtr<UBehMove> Move;
+	if (Moves.RemoveAndCopyValue(RequestID.GetID(), Move) && Move.IsValid())
+		Move->OnMoveFinished(RequestID, Result.Code);
+}
+
+void UBehaviorPathService::Tick()
+{
+	const double Now = FPlatformTime::Seconds();
+
+	// Paths that went out of date keep their memory until they are pruned.
+	if (Now - LastPruneTime > 1.0)
+	{
+		LastPruneTime = Now;
+		for (auto It = Cache.CreateIterator(); It; ++It)
+			if (!It->Value.Path->IsUpToDate() || Now - It->Value.Time >= GBehaviorPathCacheLifetime)
+				It.RemoveCurrent();
+		for (auto It = BoundComponents.CreateIterator(); It; ++It)
+			if (!It->IsValid())
+				It.RemoveCurrent();
+		for (auto It = Moves.CreateIterator(); It; ++It)
+			if (!It->Value.IsValid())
+				It.RemoveCurrent();
+	}
+
+	if (QueryQueue.Num() == 0)
+		return;
+
+	UNavigationSystemV1* NavSys = FNavigationSystem::GetCurrent<UNavigationSystemV1>(GetWorld());
+	int32 NumStarted = 0, NumTaken = 0;
+	for (; NumTaken < QueryQueue.Num(); NumTaken++)
+	{
+		if (GBehaviorPathBudget > 0 && NumStarted >= GBehaviorPathBudget)
+			break;
+
+		// Copy, notified BehMoves can request more paths
+		const FBehaviorPathKey Key = QueryQueue[NumTaken];
+		FPendingQuery* Query = Pending.Find(Key);
+		if (!Query)
+			continue;
+
+		// Finished BehMoves don't need the path anymore.
+		Query->Waiters.RemoveAll([](const FWaiter& Waiter) { return !Waiter.Move.IsValid() || Waiter.Move->PathTicket != Waiter.Ticket; });
+		const ANavigationData* NavData = Query->NavData.Get();
+		if (Query->Waiters.Num() == 0 || !NavSys || !NavData)
+		{
+			const TArray<FWaiter, TInlineAllocator<4>> Waiters = MoveTemp(Query->Waiters);
+			Pending.Remove(Key);
+			Notify(Waiters, nullptr);
+			continue;
+		}
+
+		FPathFindingQuery PathQuery(this, *NavData, Query->Start, Query->Goal, Query->Filter);
+		PathQuery.SetAllowPartialPaths(false);
+
+		Query->StartTime = Now;
+		Query->CacheGeneration = CacheGeneration;
+		NavSys->FindPathAsync(Query->AgentProperties, PathQuery,
+			FNavPathQueryDelegate::CreateUObject(this, &UBehaviorPathService::OnPathFound, Key), EPathFindingMode::Regular);
+		NumStarted++;
+	}
+	QueryQueue.RemoveAt(0, NumTaken, false);
+
+	INC_DWORD_STAT_BY(STAT_BehaviorPathQueries, NumStarted);
+}
+
+void UBehaviorPathService::OnPathFound(uint32 QueryId, ENavigationQueryResult::Type Result, FNavPathSharedPtr Path, FBehaviorPathKey Key)
+{
+	FPendingQuery Query;
+	if (!Pending.RemoveAndCopyValue(Key, Query))
+		return;
+
+	const double QueryTime = FPlatformTime::Seconds() - Query.StartTime;
+	NumQueries++;
+	TotalQueryTime += QueryTime;
+	SET_FLOAT_STAT(STAT_BehaviorPathQueryMs, QueryTime * 1000.0);
+
+	const bool bFound = Result == ENavigationQueryResult::Success && Path.IsValid() && Path->IsValid() && !Path->IsPartial();
+	if (!bFound)
+	{
+		Notify(Query.Waiters, nullptr);
+		return;
+	}
+
+	// Agents follow their own copies, the cached path is never followed or repathed.
+	Path->EnableRecalculationOnInvalidation(false);
+	if (Query.CacheGeneration == CacheGeneration && Cache.Num() < GBehaviorPathCacheSize)
+	{
+		// Registered paths are invalidated when tiles they cross are rebuilt, the observer drops them from the cache.
+		if (ANavigationData* NavData = Path->GetNavigationDataUsed())
+			NavData->RegisterActivePath(Path);
+		Path->AddObserver(FNavigationPath::FPathObserverDelegate::FDelegate::CreateUObject(this, &UBehaviorPathService::OnCachedPathEvent, Key));
+		Cache.Add(Key, { Path, FPlatformTime::Seconds() });
+	}
+
+	Notify(Query.Waiters, Path);
+}
+
+void UBehaviorPathService::Notify(const TArray<FWaiter, TInlineAllocator<4>>& Waiters, const FNavPathSharedPtr& Path)
+{
+	for (const FWaiter& Waiter : Waiters)
+		if (UBehMove* Move = Waiter.Move.Get())
+			Move->OnPathFound(Waiter.Ticket, Path);
+}
+
+void UBehaviorPathService::OnCachedPathEvent(FNavigationPath* Path, ENavPathEvent::Type Event, FBehaviorPathKey Key)
+{
+	if (Event != ENavPathEvent::Invalidated && Event != ENavPathEvent::Cleared)
+		return;
+
+	const FCachedPath* Cached = Cache.Find(Key);
+	if (Cached && Cached->Path.Get() == Path)
+		Cache.Remove(Key);
+}
+
+void UBehaviorPathService::OnNavigationGenerated(ANavigationData* NavData)
+{
+	CacheGeneration++;
+	Cache.Empty();
+}
+
+void UBehaviorPathService::Empty()
+{
+	Cache.Empty();
+	Pending.Empty();
+	QueryQueue.Empty();
+	CacheGeneration++;
+
+	for (const TWeakObjectPtr<UPathFollowingComponent>& PathFollowing : BoundComponents)
+		if (PathFollowing.IsValid())
+			PathFollowing->OnRequestFinished.RemoveAll(this);
+	BoundComponents.Empty();
+	Moves.Empty();
+}
@@ -0,0 +1,142 @@
+// (c) XenFFly
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "UObject/Object.h"
+#include "AI/Navigation/NavigationTypes.h"
+#include "NavigationData.h"
+#include "BehaviorPathService.generated.h"
+
+class AAIController;
+class UPathFollowingComponent;
+struct FPathFollowingResult;
+class UNavigationQueryFilter;
+class UBehMove;
+
+// Paths are shared by requests starting on the same poly and going to the same goal cell with the same navigation data and filter.
+struct FBehaviorPathKey
+{
+	NavNodeRef StartPoly = INVALID_NAVNODEREF;
+	FIntVector GoalCell = FIntVector::ZeroValue;
+	const ANavigationData* NavData = nullptr;
+	const UClass* FilterClass = nullptr;
+
+	bool operator==(const FBehaviorPathKey& Other) const
+	{
+		return StartPoly == Other.StartPoly && GoalCell == Other.GoalCell && NavData == Other.NavData && FilterClass == Other.FilterClass;
+	}
+
+	friend uint32 GetTypeHash(const FBehaviorPathKey& Key)
+	{
+		return HashCombine(HashCombine(GetTypeHash(Key.StartPoly), GetTypeHash(Key.GoalCell)), HashCombine(PointerHash(Key.NavData), PointerHash(Key.FilterClass)));
+	}
+};
+
+/**
+ * Path and move requests of UBehMove. Paths are cached by FBehaviorPathKey, identical requests wait for one query,
+ * and new queries are started with FindPathAsync within Behavior.PathBudget per frame.
+ * Cached paths are registered with their navigation data: they are dropped when tiles they cross are rebuilt,
+ * and the cache is cleared when navigation data is rebuilt.
+ */
+UCLASS()
+class SHATALOVBEHAVIOR_API UBehaviorPathService : public UObject
+{
+	GENERATED_BODY()
+
+public:
+	void Init();
+
+	/**
+	 * Find a path for Move from the pawn of Controller to Goal. Returns the ticket of the request, 0 if navigation can't be used
+	 * (move without the service). On a cache hit OutPath is set, otherwise UBehMove::OnPathFound is called with the ticket when the query is done.
+	 */
+	uint32 RequestPath(UBehMove* Move, AAIController* Controller, const FVector& Goal, TSubclassOf<UNavigationQueryFilter> FilterClass, FNavPathSharedPtr& OutPath);
+
+	/**
+	 * Route the completion of RequestID to Move->OnMoveFinished.
+	 * Each UPathFollowingComponent is bound once, BehMoves don't bind delegates per move.
+	 */
+	void RegisterMove(UBehMove* Move, AAIController* Controller, FAIRequestID RequestID);
+	void UnregisterMove(FAIRequestID RequestID);
+
+	// Start queued queries. Called by UBehaviorSubsystem every tick.
+	void Tick();
+
+	void Empty();
+
+	bool HasPendingWork() const { return QueryQueue.Num() > 0; };
+
+public: // Stats
+	UFUNCTION(BlueprintPure, Category = "Behavior|Path")
+	int32 GetHits() const { return Hits; };
+
+	UFUNCTION(BlueprintPure, Category = "Behavior|Path")
+	int32 GetMisses() const { return Misses; };
+
+	// Hits / (Hits + Misses), requests that joined a running query count as hits.
+	UFUNCTION(BlueprintPure, Category = "Behavior|Path")
+	float GetHitRate() const { return Hits + Misses > 0 ? (float)Hits / (Hits + Misses) : 0.f; };
+
+	// Average time from the start of a query to its result, in seconds.
+	UFUNCTION(BlueprintPure, Category = "Behavior|Path")
+	float GetAverageQueryTime() const { return NumQueries > 0 ? (float)(TotalQueryTime / NumQueries) : 0.f; };
+
+	UFUNCTION(BlueprintPure, Category = "Behavior|Path")
+	int32 GetNumCached() const { return Cache.Num(); };
+
+private:
+	struct FWaiter
+	{
+		TWeakObjectPtr<UBehMove> Move;
+		uint32 Ticket;
+	};
+
+	struct FPendingQuery
+	{
+		TArray<FWaiter, TInlineAllocator<4>> Waiters;
+		FVector Start;
+		FVector Goal;
+		TWeakObjectPtr<const ANavigationData> NavData;
+		FNavAgentProperties AgentProperties;
+		FSharedConstNavQueryFilter Filter;
+		double StartTime = 0.0;
+		uint32 CacheGeneration = 0;
+	};
+
+	struct FCachedPath
+	{
+		FNavPathSharedPtr Path;
+		double Time;
+	};
+
+	void OnPathFound(uint32 QueryId, ENavigationQueryResult::Type Result, FNavPathSharedPtr Path, FBehaviorPathKey Key);
+	void Notify(const TArray<FWaiter, TInlineAllocator<4>>& Waiters, const FNavPathSharedPtr& Path);
+
+	// Tile updates invalidate the cached paths crossing them.
+	void OnCachedPathEvent(FNavigationPath* Path, ENavPathEvent::Type Event, FBehaviorPathKey Key);
+
+	UFUNCTION()
+	void OnNavigationGenerated(ANavigationData* NavData);
+
+	void OnMoveRequestFinished(FAIRequestID RequestID, const FPathFollowingResult& Result);
+
+	// Running moves by FAIRequestID (unique across path following components).
+	TMap<uint32, TWeakObjectPtr<UBehMove>> Moves;
+	TSet<TWeakObjectPtr<UPathFollowingComponent>> BoundComponents;
+
+	TMap<FBehaviorPathKey, FCachedPath> Cache;
+	TMap<FBehaviorPathKey, FPendingQuery> Pending;
+	// Keys of Pending that wait for a query slot, oldest first.
+	TArray<FBehaviorPathKey> QueryQueue;
+
+	// Results of queries started before the cache was cleared are not cached.
+	uint32 CacheGeneration = 0;
+	uint32 NextTicket = 0;
+	double LastPruneTime = 0.0;
+
+	int32 Hits = 0;
+	int32 Misses = 0;
+	int32 NumQueries = 0;
+	double TotalQueryTime = 0.0;
+};
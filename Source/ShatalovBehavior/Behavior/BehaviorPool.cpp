@@ -0,0 +1,80 @@
+// (c) XenFFly
+
+#include "BehaviorPool.h"
+
+#include "Base/Behavior.h"
+
+UBehavior* UBehaviorPool::Acquire(UObject* Outer, TSubclassOf<UBehavior> Class)
+{
+	const UBehavior* Defaults = Class->GetDefaultObject<UBehavior>();
+	if (Defaults->PoolSize <= 0)
+		return NewObject<UBehavior>(Outer, Class);
+
+	FBehaviorPoolList* List = FreeLists.Find(Class);
+	if (List && List->Behaviors.Num() > 0)
+	{
+		Hits++;
+		NumPooled--;
+		UBehavior* Behavior = List->Behaviors.Pop(false);
+		Behavior->bInPool = false;
+		return Behavior;
+	}
+
+	// Pooled Behaviors are outered to the pool, so a reused Behavior doesn't keep its first parent alive.
+	Misses++;
+	return NewObject<UBehavior>(this, Class);
+}
+
+bool UBehaviorPool::Release(UBehavior* Behavior)
+{
+	// Already released, a second OnDestroy must not put it in the pool twice.
+	if (!IsValid(Behavior) || Behavior->PoolSize <= 0 || Behavior->bInPool)
+		return false;
+
+	FBehaviorPoolList& List = FreeLists.FindOrAdd(Behavior->GetClass());
+	if (List.Behaviors.Num() + List.NumPending >= Behavior->PoolSize)
+		return false;
+
+	Behavior->bInPool = true;
+	List.NumPending++;
+	PendingRelease.Add(Behavior);
+	return true;
+}
+
+void UBehaviorPool::Flush()
+{
+	for (UBehavior* Behavior : PendingRelease)
+	{
+		if (!Behavior)
+			continue;
+
+		FBehaviorPoolList& List = FreeLists.FindOrAdd(Behavior->GetClass());
+		List.NumPending--;
+
+		if (Behavior->IsPendingKill())
+			continue;
+
+		Behavior->ResetBehavior();
+		List.Behaviors.Add(Behavior);
+		NumPooled++;
+	}
+	PendingRelease.Reset();
+}
+
+void UBehaviorPool::Empty()
+{
+	for (TPair<UClass*, FBehaviorPoolList>& Pair : FreeLists)
+		for (UBehavior* Behavior : Pair.Value.Behaviors)
+			if (Behavior)
+				Behavior->MarkPendingKill();
+
+	FreeLists.Empty();
+	PendingRelease.Empty();
+	NumPooled = 0;
+}
+
+int32 UBehaviorPool::GetNumPooledOfClass(TSubclassOf<UBehavior> Class) const
+{
+	const FBehaviorPoolList* List = FreeLists.Find(Class);
+	return List ? List->Behaviors.Num() : 0;
+}
@@ -0,0 +1,74 @@
+// (c) XenFFly
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "UObject/Object.h"
+#include "BehaviorPool.generated.h"
+
+class UBehavior;
+
+USTRUCT()
+struct FBehaviorPoolList
+{
+	GENERATED_BODY()
+
+public:
+	UPROPERTY()
+	TArray<UBehavior*> Behaviors;
+
+	// Released, but not flushed yet.
+	int32 NumPending = 0;
+};
+
+/**
+ * Finished Behaviors kept for reuse by RunBehavior, per class.
+ * Only classes with PoolSize > 0 are pooled, PoolSize is also the cap of the class.
+ */
+UCLASS()
+class SHATALOVBEHAVIOR_API UBehaviorPool : public UObject
+{
+	GENERATED_BODY()
+
+public:
+	// Returns a pooled Behavior of this class or creates a new one.
+	UBehavior* Acquire(UObject* Outer, TSubclassOf<UBehavior> Class);
+
+	/**
+	 * Take a finished (or never initialized) Behavior. Returns false if the class is not pooled or the pool is full.
+	 * The Behavior is reset and becomes available on the next Flush, so the current finish can complete safely.
+	 */
+	bool Release(UBehavior* Behavior);
+
+	// Reset released Behaviors and make them available. Called by UBehaviorSubsystem every tick.
+	void Flush();
+
+	void Empty();
+
+	bool HasPendingReleases() const { return PendingRelease.Num() > 0; };
+
+public: // Stats
+	UFUNCTION(BlueprintPure, Category = "Behavior|Pool")
+	int32 GetHits() const { return Hits; };
+
+	UFUNCTION(BlueprintPure, Category = "Behavior|Pool")
+	int32 GetMisses() const { return Misses; };
+
+	// Total number of Behaviors available in the pool.
+	UFUNCTION(BlueprintPure, Category = "Behavior|Pool")
+	int32 GetNumPooled() const { return NumPooled; };
+
+	UFUNCTION(BlueprintPure, Category = "Behavior|Pool")
+	int32 GetNumPooledOfClass(TSubclassOf<UBehavior> Class) const;
+
+private:
+	UPROPERTY()
+	TMap<UClass*, FBehaviorPoolList> FreeLists;
+
+	UPROPERTY()
+	TArray<UBehavior*> PendingRelease;
+
+	int32 Hits = 0;
+	int32 Misses = 0;
+	int32 NumPooled = 0;
+};
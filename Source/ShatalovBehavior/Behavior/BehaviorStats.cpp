@@ -0,0 +1,29 @@
+// (c) XenFFly
+
+#include "BehaviorStats.h"
+
+DEFINE_STAT(STAT_BehaviorTick);
+DEFINE_STAT(STAT_BehaviorSelect);
+DEFINE_STAT(STAT_BehaviorRun);
+DEFINE_STAT(STAT_BehaviorFinish);
+
+DEFINE_STAT(STAT_BehaviorNumDefault);
+DEFINE_STAT(STAT_BehaviorNumParallel);
+DEFINE_STAT(STAT_BehaviorNumBase);
+DEFINE_STAT(STAT_BehaviorNumQueued);
+DEFINE_STAT(STAT_BehaviorSelectQueue);
+
+DEFINE_STAT(STAT_BehaviorSelections);
+DEFINE_STAT(STAT_BehaviorSelectWaitMax);
+DEFINE_STAT(STAT_BehaviorFinished);
+DEFINE_STAT(STAT_BehaviorOverrides);
+DEFINE_STAT(STAT_BehaviorQueueDropped);
+DEFINE_STAT(STAT_BehaviorQueueRejected);
+DEFINE_STAT(STAT_BehaviorPathHits);
+DEFINE_STAT(STAT_BehaviorPathMisses);
+DEFINE_STAT(STAT_BehaviorPathQueries);
+DEFINE_STAT(STAT_BehaviorPathQueryMs);
+DEFINE_STAT(STAT_BehaviorClassLoads);
+DEFINE_STAT(STAT_BehaviorClassLoadMs);
+
+UE_TRACE_CHANNEL_DEFINE(BehaviorChannel);
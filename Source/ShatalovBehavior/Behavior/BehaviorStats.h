@@ -0,0 +1,44 @@
+// (c) XenFFly
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Stats/Stats.h"
+#include "Trace/Trace.h"
+#include "ProfilingDebugging/CpuProfilerTrace.h"
+
+DECLARE_STATS_GROUP(TEXT("Behavior"), STATGROUP_Behavior, STATCAT_Advanced);
+
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Tick"), STAT_BehaviorTick, STATGROUP_Behavior, SHATALOVBEHAVIOR_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("SelectBehavior"), STAT_BehaviorSelect, STATGROUP_Behavior, SHATALOVBEHAVIOR_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("RunBehavior"), STAT_BehaviorRun, STATGROUP_Behavior, SHATALOVBEHAVIOR_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("FinishBehavior"), STAT_BehaviorFinish, STATGROUP_Behavior, SHATALOVBEHAVIOR_API);
+
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Default Behaviors"), STAT_BehaviorNumDefault, STATGROUP_Behavior, SHATALOVBEHAVIOR_API);
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Parallel Behaviors"), STAT_BehaviorNumParallel, STATGROUP_Behavior, SHATALOVBEHAVIOR_API);
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Base Behaviors"), STAT_BehaviorNumBase, STATGROUP_Behavior, SHATALOVBEHAVIOR_API);
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Queued Behaviors"), STAT_BehaviorNumQueued, STATGROUP_Behavior, SHATALOVBEHAVIOR_API);
+
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Queued Selections"), STAT_BehaviorSelectQueue, STATGROUP_Behavior, SHATALOVBEHAVIOR_API);
+
+// Counters are reset every frame
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Selections"), STAT_BehaviorSelections, STATGROUP_Behavior, SHATALOVBEHAVIOR_API);
+DECLARE_FLOAT_COUNTER_STAT_EXTERN(TEXT("Selection Wait Max (ms)"), STAT_BehaviorSelectWaitMax, STATGROUP_Behavior, SHATALOVBEHAVIOR_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Finished"), STAT_BehaviorFinished, STATGROUP_Behavior, SHATALOVBEHAVIOR_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Overrides"), STAT_BehaviorOverrides, STATGROUP_Behavior, SHATALOVBEHAVIOR_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Queue Dropped"), STAT_BehaviorQueueDropped, STATGROUP_Behavior, SHATALOVBEHAVIOR_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Queue Rejected"), STAT_BehaviorQueueRejected, STATGROUP_Behavior, SHATALOVBEHAVIOR_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Path Cache Hits"), STAT_BehaviorPathHits, STATGROUP_Behavior, SHATALOVBEHAVIOR_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Path Cache Misses"), STAT_BehaviorPathMisses, STATGROUP_Behavior, SHATALOVBEHAVIOR_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Path Queries"), STAT_BehaviorPathQueries, STATGROUP_Behavior, SHATALOVBEHAVIOR_API);
+DECLARE_FLOAT_COUNTER_STAT_EXTERN(TEXT("Path Query Time (ms)"), STAT_BehaviorPathQueryMs, STATGROUP_Behavior, SHATALOVBEHAVIOR_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Class Loads"), STAT_BehaviorClassLoads, STATGROUP_Behavior, SHATALOVBEHAVIOR_API);
+DECLARE_FLOAT_COUNTER_STAT_EXTERN(TEXT("Class Load Time (ms)"), STAT_BehaviorClassLoadMs, STATGROUP_Behavior, SHATALOVBEHAVIOR_API);
+
+// Insights channel, enable with -trace=cpu,behavior (works without stats, e.g. on a shipping server).
+UE_TRACE_CHANNEL_EXTERN(BehaviorChannel, SHATALOVBEHAVIOR_API);
+
+// Stat cycle counter + Insights CPU event on BehaviorChannel.
+#define BEHAVIOR_SCOPE_CYCLE_COUNTER(Stat) \
+	SCOPE_CYCLE_COUNTER(Stat); \
+	TRACE_CPUPROFILER_EVENT_SCOPE_ON_CHANNEL_STR(#Stat, BehaviorChannel)
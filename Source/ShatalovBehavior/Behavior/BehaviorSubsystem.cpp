@@ -0,0 +1,560 @@
+// (c) XenFFly
+
+#include "BehaviorSubsystem.h"
+
+#include "BehaviorClassLoader.h"
+#include "BehaviorPathService.h"
+#include "BehaviorPool.h"
+#include "BehaviorStats.h"
+#include "Base/Behavior.h"
+#include "GameplayTasksComponent.h"
+#include "Async/ParallelFor.h"
+#include "GameFramework/PlayerController.h"
+#include "HAL/IConsoleManager.h"
+
+static int32 GBehaviorSelectBudget = 0;
+static FAutoConsoleVariableRef CVarBehaviorSelectBudget(
+	TEXT("Behavior.SelectBudget"),
+	GBehaviorSelectBudget,
+	TEXT("Max number of Base selections per frame, the rest wait for the next frames (0 - unlimited)."));
+
+static float GBehaviorSelectBudgetMs = 0.f;
+static FAutoConsoleVariableRef CVarBehaviorSelectBudgetMs(
+	TEXT("Behavior.SelectBudgetMs"),
+	GBehaviorSelectBudgetMs,
+	TEXT("Max time spent in Base selections per frame, in milliseconds (0 - unlimited)."));
+
+static int32 GBehaviorSelectBypassPriority = 0;
+static FAutoConsoleVariableRef CVarBehaviorSelectBypassPriority(
+	TEXT("Behavior.SelectBypassPriority"),
+	GBehaviorSelectBypassPriority,
+	TEXT("Bases with Priority <= this value are selected without waiting for the budget (-1 - none)."));
+
+static int32 GBehaviorSelectParallel = 1;
+static FAutoConsoleVariableRef CVarBehaviorSelectParallel(
+	TEXT("Behavior.SelectParallel"),
+	GBehaviorSelectParallel,
+	TEXT("Run the data phase of Base selections (cooldowns, eligibility, weighted pick) on worker threads (0 - game thread)."));
+
+static int32 GBehaviorSelectBatchSize = 256;
+static FAutoConsoleVariableRef CVarBehaviorSelectBatchSize(
+	TEXT("Behavior.SelectBatchSize"),
+	GBehaviorSelectBatchSize,
+	TEXT("Number of Base selections prepared together. Behavior.SelectBudgetMs is checked between batches."));
+
+static int32 GBehaviorSelectParallelMin = 32;
+static FAutoConsoleVariableRef CVarBehaviorSelectParallelMin(
+	TEXT("Behavior.SelectParallelMin"),
+	GBehaviorSelectParallelMin,
+	TEXT("Smaller batches are prepared on the game thread."));
+
+void UBehaviorSubsystem::Initialize(FSubsystemCollectionBase& Collection)
+{
+	Super::Initialize(Collection);
+
+	Pool = NewObject<UBehaviorPool>(this, TEXT("BehaviorPool"));
+	PathService = NewObject<UBehaviorPathService>(this, TEXT("BehaviorPathService"));
+	PathService->Init();
+	ClassLoader = NewObject<UBehaviorClassLoader>(this, TEXT("BehaviorClassLoader"));
+	SeedStream.GenerateNewSeed();
+}
+
+void UBehaviorSubsystem::Deinitialize()
+{
+	for (FBehaviorTickBucket& Bucket : Buckets)
+		for (UBehavior* Behavior : Bucket.Behaviors)
+			if (Behavior)
+			{
+				Behavior->TickBucket = INDEX_NONE;
+				Behavior->TickSlot = INDEX_NONE;
+			}
+
+	Buckets.Empty();
+	BucketIndices.Empty();
+	NumTicking = 0;
+	NumSleeping = 0;
+
+	if (Pool)
+		Pool->Empty();
+	if (PathService)
+		PathService->Empty();
+	if (ClassLoader)
+		ClassLoader->Empty();
+	SelectionTables.Empty();
+	ParallelBehaviors.Empty();
+	PendingFinishes.Empty();
+	DeferredRepeats.Empty();
+	SelectionQueue.Empty();
+	BypassSelectionQueue.Empty();
+	SelectionBatch.Empty();
+	SelectionDecisions.Empty();
+	LODRoots.Empty();
+	LODSettings.Empty();
+	AgentStageEpochs.Empty();
+	ExhaustedBases.Empty();
+
+	Super::Deinitialize();
+}
+
+void UBehaviorSubsystem::Tick(float DeltaTime)
+{
+	TRACE_CPUPROFILER_EVENT_SCOPE_ON_CHANNEL_STR("UBehaviorSubsystem::Tick", BehaviorChannel);
+	const double StartTime = FPlatformTime::Seconds();
+
+	// Behaviors released last frame are no longer referenced by their finish code.
+	Pool->Flush();
+
+	FlushPendingFinishes();
+	UpdateLOD(DeltaTime);
+
+	bIsTicking = true;
+	NumTickedLastFrame = 0;
+
+	// Buckets may be added while ticking, so index them every time.
+	for (int32 BucketIndex = 0; BucketIndex < Buckets.Num(); BucketIndex++)
+	{
+		const bool bDispatchBehTick = Buckets[BucketIndex].bImplementsBehTick;
+
+		// Behaviors registered during this loop are ticked next frame.
+		const int32 NumSlots = Buckets[BucketIndex].Behaviors.Num();
+		for (int32 Slot = 0; Slot < NumSlots; Slot++)
+		{
+			UBehavior* Behavior = Buckets[BucketIndex].Behaviors[Slot];
+			if (!Behavior)
+			{
+				Buckets[BucketIndex].bNeedsCompaction = true;
+				continue;
+			}
+
+			if (!Behavior->IsPendingKill())
+			{
+				// LOD chains are ticked every TickInterval with the accumulated time.
+				float BehaviorDeltaTime = DeltaTime;
+				const UBehavior* Root = Behavior->InterruptRoot;
+				if (Root && Root->LODLevel > 0)
+				{
+					if (!Root->bLODTick)
+						continue;
+					BehaviorDeltaTime = Root->LODDeltaTime;
+				}
+
+				Behavior->TickBehavior(BehaviorDeltaTime, bDispatchBehTick);
+				NumTickedLastFrame++;
+			}
+		}
+	}
+
+	bIsTicking = false;
+	CompactBuckets();
+
+	RunSelections();
+	PathService->Tick();
+
+	LastTickSeconds = FPlatformTime::Seconds() - StartTime;
+}
+
+bool UBehaviorSubsystem::IsTickable() const
+{
+	return NumTicking > 0 || LODRoots.Num() > 0 || PendingFinishes.Num() > 0 || GetNumQueuedSelections() > 0 || (Pool && Pool->HasPendingReleases()) ||
+		(PathService && PathService->HasPendingWork());
+}
+
+void UBehaviorSubsystem::UpdateLOD(float DeltaTime)
+{
+	if (LODRoots.Num() == 0)
+		return;
+
+	ViewLocations.Reset();
+	for (FConstPlayerControllerIterator It = GetWorld()->GetPlayerControllerIterator(); It; ++It)
+	{
+		if (APlayerController* PlayerController = It->Get())
+		{
+			FVector Location;
+			FRotator Rotation;
+			PlayerController->GetPlayerViewPoint(Location, Rotation);
+			ViewLocations.Add(Location);
+		}
+	}
+
+	for (int32 i = LODRoots.Num() - 1; i >= 0; i--)
+	{
+		if (IsValid(LODRoots[i]))
+			LODRoots[i]->UpdateLOD(DeltaTime, ViewLocations);
+		else LODRoots.RemoveAtSwap(i, 1, false);
+	}
+}
+
+TSharedPtr<const FBehaviorLODSettings> UBehaviorSubsystem::GetLODSettings(const FBehaviorLODSettings& Settings)
+{
+	FBehaviorLODSettings Sorted = Settings;
+	Sorted.Bands.Sort([](const FBehaviorLODBand& Lhs, const FBehaviorLODBand& Rhs) { return Lhs.Distance < Rhs.Distance; });
+
+	// Few distinct settings (usually one per owner class).
+	for (const TSharedPtr<const FBehaviorLODSettings>& Shared : LODSettings)
+	{
+		if (Shared->Hysteresis != Sorted.Hysteresis || Shared->Bands.Num() != Sorted.Bands.Num())
+			continue;
+
+		bool bSame = true;
+		for (int32 i = 0; i < Sorted.Bands.Num() && bSame; i++)
+			bSame = Shared->Bands[i].Distance == Sorted.Bands[i].Distance && Shared->Bands[i].TickInterval == Sorted.Bands[i].TickInterval &&
+				Shared->Bands[i].bFreezeSelection == Sorted.Bands[i].bFreezeSelection;
+		if (bSame)
+			return Shared;
+	}
+
+	return LODSettings.Add_GetRef(MakeShared<const FBehaviorLODSettings>(MoveTemp(Sorted)));
+}
+
+void UBehaviorSubsystem::RefreshLevel()
+{
+	StageEpoch++;
+	WakeExhaustedBases();
+}
+
+void UBehaviorSubsystem::WakeExhaustedBases()
+{
+	TArray<UBehavior*> Exhausted = MoveTemp(ExhaustedBases);
+	ExhaustedBases.Reset();
+	for (UBehavior* Behavior : Exhausted)
+	{
+		if (IsValid(Behavior))
+		{
+			Behavior->bStageExhausted = false;
+			Behavior->WakeBehavior();
+		}
+	}
+}
+
+void UBehaviorSubsystem::RefreshAgentLevel(UGameplayTasksComponent* Agent)
+{
+	if (!Agent)
+		return;
+
+	const TWeakObjectPtr<UGameplayTasksComponent> Key(Agent);
+	if (AgentStageEpochs.Num() >= AgentStageEpochsPruneSize && !AgentStageEpochs.Contains(Key))
+	{
+		// Remove destroyed agents, amortized over the added ones.
+		for (auto It = AgentStageEpochs.CreateIterator(); It; ++It)
+			if (!It.Key().IsValid())
+				It.RemoveCurrent();
+		AgentStageEpochs.Compact();
+		AgentStageEpochsPruneSize = FMath::Max(16, AgentStageEpochs.Num() * 2);
+	}
+	AgentStageEpochs.FindOrAdd(Key)++;
+
+	for (int32 i = ExhaustedBases.Num() - 1; i >= 0; i--)
+	{
+		UBehavior* Behavior = ExhaustedBases[i];
+		if (!IsValid(Behavior))
+			ExhaustedBases.RemoveAtSwap(i, 1, false);
+		else if (Behavior->GetGameplayTasksComponent() == Agent)
+		{
+			ExhaustedBases.RemoveAtSwap(i, 1, false);
+			Behavior->bStageExhausted = false;
+			Behavior->WakeBehavior();
+		}
+	}
+}
+
+uint32 UBehaviorSubsystem::GetStageEpoch(const UGameplayTasksComponent* Agent) const
+{
+	if (AgentStageEpochs.Num() == 0 || !Agent)
+		return StageEpoch;
+
+	const uint32* AgentEpoch = AgentStageEpochs.Find(MakeWeakObjectPtr(const_cast<UGameplayTasksComponent*>(Agent)));
+	return StageEpoch + (AgentEpoch ? *AgentEpoch : 0);
+}
+
+void UBehaviorSubsystem::RequestSelection(UBehavior* Behavior)
+{
+	if (Behavior->bSelectionQueued)
+		return;
+
+	Behavior->bSelectionQueued = true;
+	FBehaviorSelectionRequest Request{ Behavior, FPlatformTime::Seconds() };
+	if (Behavior->Priority <= GBehaviorSelectBypassPriority)
+		BypassSelectionQueue.Add(Request);
+	else SelectionQueue.Add(Request);
+}
+
+void UBehaviorSubsystem::RunSelections()
+{
+	if (GetNumQueuedSelections() == 0)
+		return;
+
+	const double StartTime = FPlatformTime::Seconds();
+	double FrameMaxWait = 0.0;
+
+	// Selections can request more (Base in Base), they wait for the next frame.
+	TArray<FBehaviorSelectionRequest> Bypass = MoveTemp(BypassSelectionQueue);
+	BypassSelectionQueue.Reset();
+	for (const FBehaviorSelectionRequest& Request : Bypass)
+		if (ClaimSelection(Request, StartTime))
+			FrameMaxWait = FMath::Max(FrameMaxWait, StartTime - Request.RequestTime);
+	RunSelectionBatch();
+
+	// Oldest first, so every Base is selected after a bounded number of frames.
+	const int32 NumRequests = SelectionQueue.Num();
+	const int32 BatchSize = FMath::Max(GBehaviorSelectBatchSize, 1);
+	int32 NumSelected = 0, NumProcessed = 0;
+	while (NumProcessed < NumRequests)
+	{
+		if (GBehaviorSelectBudget > 0 && NumSelected >= GBehaviorSelectBudget)
+			break;
+		if (GBehaviorSelectBudgetMs > 0.f && (FPlatformTime::Seconds() - StartTime) * 1000.0 >= GBehaviorSelectBudgetMs)
+			break;
+
+		const int32 MaxSelected = GBehaviorSelectBudget > 0 ? FMath::Min(NumSelected + BatchSize, GBehaviorSelectBudget) : NumSelected + BatchSize;
+		for (; NumProcessed < NumRequests && NumSelected < MaxSelected; NumProcessed++)
+		{
+			const FBehaviorSelectionRequest& Request = SelectionQueue[NumProcessed];
+			if (ClaimSelection(Request, StartTime))
+			{
+				NumSelected++;
+				FrameMaxWait = FMath::Max(FrameMaxWait, StartTime - Request.RequestTime);
+			}
+		}
+
+		// Applied selections can add requests, SelectionQueue isn't referenced after this.
+		RunSelectionBatch();
+	}
+	SelectionQueue.RemoveAt(0, NumProcessed, false);
+
+	SET_DWORD_STAT(STAT_BehaviorSelectQueue, GetNumQueuedSelections());
+	SET_FLOAT_STAT(STAT_BehaviorSelectWaitMax, FrameMaxWait * 1000.0);
+}
+
+bool UBehaviorSubsystem::ClaimSelection(const FBehaviorSelectionRequest& Request, double Now)
+{
+	UBehavior* Behavior = Request.Behavior.Get();
+
+	// Finished (or reused by the pool) while waiting
+	if (!Behavior || !Behavior->bSelectionQueued)
+		return false;
+
+	Behavior->bSelectionQueued = false;
+
+	const double Wait = Now - Request.RequestTime;
+	TotalSelectionWait += Wait;
+	MaxSelectionWait = FMath::Max(MaxSelectionWait, Wait);
+	NumScheduledSelections++;
+
+	if (!Behavior->IsSelectionFrozen() && Behavior->CanSelectBehavior())
+		SelectionBatch.Add(Behavior);
+	else Behavior->OnSelectionDropped();
+	return true;
+}
+
+void UBehaviorSubsystem::RunSelectionBatch()
+{
+	if (SelectionBatch.Num() == 0)
+		return;
+
+	BEHAVIOR_SCOPE_CYCLE_COUNTER(STAT_BehaviorSelect);
+
+	// Data phase: every Base touches only its own data.
+	const float Now = GetWorld()->GetTimeSeconds();
+	SelectionDecisions.SetNum(SelectionBatch.Num(), false);
+	const bool bSingleThread = GBehaviorSelectParallel == 0 || SelectionBatch.Num() < GBehaviorSelectParallelMin;
+	ParallelFor(SelectionBatch.Num(), [this, Now](int32 Index)
+	{
+		SelectionDecisions[Index] = SelectionBatch[Index]->PrepareSelection(Now);
+	}, bSingleThread);
+
+	// Apply in request order, so the result doesn't depend on the number of workers.
+	SelectionBatch.Reset();
+	TArray<FBehaviorSelectionDecision> Decisions = MoveTemp(SelectionDecisions);
+	for (const FBehaviorSelectionDecision& Decision : Decisions)
+		Decision.Base->ApplySelection(Decision);
+
+	Decisions.Reset();
+	SelectionDecisions = MoveTemp(Decisions);
+}
+
+void UBehaviorSubsystem::FlushPendingFinishes()
+{
+	if (PendingFinishes.Num() == 0)
+		return;
+
+	TArray<UBehavior*> Finishes = MoveTemp(PendingFinishes);
+	PendingFinishes.Reset();
+	Finishes.RemoveAll([](UBehavior* Behavior) { return !IsValid(Behavior); });
+
+	// Children first, as FinishBehavior does.
+	Finishes.Sort([](const UBehavior& Lhs, const UBehavior& Rhs) { return Lhs.GetBehaviorDepth() > Rhs.GetBehaviorDepth(); });
+	for (UBehavior* Behavior : Finishes)
+		Behavior->FlushPendingFinish();
+}
+
+void UBehaviorSubsystem::EndFinishCascade()
+{
+	if (FinishCascadeDepth == 1)
+	{
+		// New Behaviors can finish more, they are added to the end.
+		for (int32 i = 0; i < DeferredRepeats.Num(); i++)
+		{
+			UBehavior* Base = DeferredRepeats[i].Get();
+			if (Base && Base->IsBehaviorValid() && !Base->bIsFinishing && !Base->GetChildBehavior())
+				Base->ContinueBase();
+		}
+		DeferredRepeats.Reset();
+	}
+	FinishCascadeDepth--;
+}
+
+bool UBehaviorSubsystem::DeferBaseRepeat(UBehavior* Base)
+{
+	if (FinishCascadeDepth == 0)
+		return false;
+
+	DeferredRepeats.Add(Base);
+	return true;
+}
+
+ETickableTickType UBehaviorSubsystem::GetTickableTickType() const
+{
+	return HasAnyFlags(RF_ClassDefaultObject) ? ETickableTickType::Never : ETickableTickType::Conditional;
+}
+
+TStatId UBehaviorSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UBehaviorSubsystem, STATGROUP_Tickables);
+}
+
+void UBehaviorSubsystem::RegisterBehavior(UBehavior* Behavior)
+{
+	if (!IsValid(Behavior) || Behavior->TickSlot != INDEX_NONE)
+		return;
+
+	UClass* Class = Behavior->GetClass();
+	int32* FoundIndex = BucketIndices.Find(Class);
+	if (!FoundIndex)
+	{
+		FBehaviorTickBucket& NewBucket = Buckets.AddDefaulted_GetRef();
+		NewBucket.Class = Class;
+		NewBucket.bImplementsBehTick = Class->IsFunctionImplementedInScript(GET_FUNCTION_NAME_CHECKED(UBehavior, BehTick));
+		FoundIndex = &BucketIndices.Add(Class, Buckets.Num() - 1);
+	}
+
+	Behavior->TickBucket = *FoundIndex;
+	Behavior->TickSlot = Buckets[*FoundIndex].Behaviors.Add(Behavior);
+	NumTicking++;
+}
+
+void UBehaviorSubsystem::UnregisterBehavior(UBehavior* Behavior)
+{
+	if (!Behavior)
+		return;
+
+	if (Behavior->bSleeping)
+	{
+		Behavior->bSleeping = false;
+		NumSleeping--;
+		return;
+	}
+
+	if (!Buckets.IsValidIndex(Behavior->TickBucket))
+		return;
+
+	FBehaviorTickBucket& Bucket = Buckets[Behavior->TickBucket];
+	if (Bucket.Behaviors.IsValidIndex(Behavior->TickSlot) && Bucket.Behaviors[Behavior->TickSlot] == Behavior)
+	{
+		if (bIsTicking)
+		{
+			// Don't shift the array under the tick loop.
+			Bucket.Behaviors[Behavior->TickSlot] = nullptr;
+			Bucket.bNeedsCompaction = true;
+		}
+		else
+		{
+			Bucket.Behaviors.RemoveAtSwap(Behavior->TickSlot, 1, false);
+			if (Bucket.Behaviors.IsValidIndex(Behavior->TickSlot) && Bucket.Behaviors[Behavior->TickSlot])
+				Bucket.Behaviors[Behavior->TickSlot]->TickSlot = Behavior->TickSlot;
+		}
+		NumTicking--;
+	}
+
+	Behavior->TickBucket = INDEX_NONE;
+	Behavior->TickSlot = INDEX_NONE;
+}
+
+void UBehaviorSubsystem::SleepBehavior(UBehavior* Behavior)
+{
+	if (!Behavior || Behavior->bSleeping || Behavior->TickSlot == INDEX_NONE)
+		return;
+
+	UnregisterBehavior(Behavior);
+	Behavior->bSleeping = true;
+	NumSleeping++;
+}
+
+void UBehaviorSubsystem::WakeBehavior(UBehavior* Behavior)
+{
+	if (!Behavior || !Behavior->bSleeping)
+		return;
+
+	Behavior->bSleeping = false;
+	NumSleeping--;
+	RegisterBehavior(Behavior);
+}
+
+void UBehaviorSubsystem::AddParallelBehavior(UBehavior* Behavior)
+{
+	UGameplayTasksComponent* Component = Behavior->GetGameplayTasksComponent();
+	if (!Component || Behavior->bInParallelIndex)
+		return;
+
+	ParallelBehaviors.FindOrAdd(Component).Behaviors.Add(Behavior);
+	Behavior->bInParallelIndex = true;
+}
+
+void UBehaviorSubsystem::RemoveParallelBehavior(UBehavior* Behavior)
+{
+	if (!Behavior->bInParallelIndex)
+		return;
+
+	Behavior->bInParallelIndex = false;
+	UGameplayTasksComponent* Component = Behavior->GetGameplayTasksComponent();
+	if (FBehaviorParallelSet* Set = ParallelBehaviors.Find(Component))
+	{
+		Set->Behaviors.RemoveSingleSwap(Behavior, false);
+		if (Set->Behaviors.Num() == 0)
+			ParallelBehaviors.Remove(Component);
+	}
+}
+
+TArrayView<UBehavior* const> UBehaviorSubsystem::GetParallelBehaviors(const UGameplayTasksComponent* Component) const
+{
+	const FBehaviorParallelSet* Set = ParallelBehaviors.Find(const_cast<UGameplayTasksComponent*>(Component));
+	return Set ? TArrayView<UBehavior* const>(Set->Behaviors) : TArrayView<UBehavior* const>();
+}
+
+TSharedPtr<const FBehaviorSelectionTable> UBehaviorSubsystem::GetSelectionTable(const UBehavior* Behavior)
+{
+	TSharedPtr<const FBehaviorSelectionTable>& Table = SelectionTables.FindOrAdd(Behavior->GetClass());
+	if (!Table.IsValid())
+		Table = MakeShared<FBehaviorSelectionTable>(Behavior->GetClass()->GetDefaultObject<UBehavior>()->Behaviors);
+	return Table;
+}
+
+void UBehaviorSubsystem::CompactBuckets()
+{
+	for (FBehaviorTickBucket& Bucket : Buckets)
+	{
+		if (!Bucket.bNeedsCompaction)
+			continue;
+
+		int32 WriteSlot = 0;
+		for (int32 ReadSlot = 0; ReadSlot < Bucket.Behaviors.Num(); ReadSlot++)
+		{
+			if (UBehavior* Behavior = Bucket.Behaviors[ReadSlot])
+			{
+				Behavior->TickSlot = WriteSlot;
+				Bucket.Behaviors[WriteSlot++] = Behavior;
+			}
+		}
+		Bucket.Behaviors.SetNum(WriteSlot, false);
+		Bucket.bNeedsCompaction = false;
+	}
+}
@@ -0,0 +1,255 @@
+// (c) XenFFly
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "Tickable.h"
+#include "BehaviorTrace.h"
+#include "BehaviorLOD.h"
+#include "Base/BehaviorSelector.h"
+#include "BehaviorSubsystem.generated.h"
+
+class UBehavior;
+class UBehaviorPool;
+class UBehaviorPathService;
+class UBehaviorClassLoader;
+class UGameplayTasksComponent;
+
+// Active Behaviors of one class, ticked together.
+USTRUCT()
+struct FBehaviorTickBucket
+{
+	GENERATED_BODY()
+
+public:
+	UPROPERTY()
+	UClass* Class = nullptr;
+
+	UPROPERTY()
+	TArray<UBehavior*> Behaviors;
+
+	// BehTick is dispatched only if the class implements it.
+	bool bImplementsBehTick = false;
+
+	// Some slots were freed while ticking, compact them after the loop.
+	bool bNeedsCompaction = false;
+};
+
+// BT_Parallel Behaviors of one UGameplayTasksComponent.
+USTRUCT()
+struct FBehaviorParallelSet
+{
+	GENERATED_BODY()
+
+public:
+	UPROPERTY()
+	TArray<UBehavior*> Behaviors;
+};
+
+// Base Behavior waiting for its selection.
+struct FBehaviorSelectionRequest
+{
+	TWeakObjectPtr<UBehavior> Behavior;
+	double RequestTime;
+};
+
+/**
+ * Owns Behavior ticking for a world.
+ * Behaviors register in Activate and unregister in OnDestroy, and are ticked in one loop (grouped by class)
+ * instead of being ticked one by one by their UGameplayTasksComponent.
+ */
+UCLASS()
+class SHATALOVBEHAVIOR_API UBehaviorSubsystem : public UWorldSubsystem, public FTickableGameObject
+{
+	GENERATED_BODY()
+
+public:
+	virtual void Initialize(FSubsystemCollectionBase& Collection) override;
+	virtual void Deinitialize() override;
+
+	// FTickableGameObject
+	virtual void Tick(float DeltaTime) override;
+	virtual ETickableTickType GetTickableTickType() const override;
+	virtual bool IsTickable() const override;
+	virtual TStatId GetStatId() const override;
+	virtual UWorld* GetTickableGameObjectWorld() const override { return GetWorld(); };
+	// ~FTickableGameObject
+
+	void RegisterBehavior(UBehavior* Behavior);
+	void UnregisterBehavior(UBehavior* Behavior);
+
+	// Stop ticking a Behavior until WakeBehavior is called.
+	void SleepBehavior(UBehavior* Behavior);
+	void WakeBehavior(UBehavior* Behavior);
+
+	// Number of awake Behaviors ticked by this subsystem.
+	UFUNCTION(BlueprintPure, Category = Behavior)
+	int32 GetNumTickingBehaviors() const { return NumTicking; };
+
+	// Number of sleeping (tick on demand) Behaviors.
+	UFUNCTION(BlueprintPure, Category = Behavior)
+	int32 GetNumSleepingBehaviors() const { return NumSleeping; };
+
+	// Number of TickBehavior calls during the last frame.
+	UFUNCTION(BlueprintPure, Category = Behavior)
+	int32 GetNumTickedLastFrame() const { return NumTickedLastFrame; };
+
+	// Time spent in the last Tick, in seconds.
+	double GetLastTickSeconds() const { return LastTickSeconds; };
+
+	// First Behaviors with LOD enabled, their LOD is updated every frame.
+	void RegisterLODRoot(UBehavior* Behavior) { LODRoots.Add(Behavior); };
+	void UnregisterLODRoot(UBehavior* Behavior) { LODRoots.RemoveSingleSwap(Behavior, false); };
+	// Settings with sorted bands, shared by every root using the same settings.
+	TSharedPtr<const FBehaviorLODSettings> GetLODSettings(const FBehaviorLODSettings& Settings);
+
+	/**
+	 * Queue SelectBehavior of a Base without a child. Selections run after the Behaviors are ticked, oldest first,
+	 * within Behavior.SelectBudget / Behavior.SelectBudgetMs per frame. Bases with Priority <= Behavior.SelectBypassPriority skip the budget.
+	 */
+	void RequestSelection(UBehavior* Behavior);
+
+	// Number of Base Behaviors waiting for their selection.
+	UFUNCTION(BlueprintPure, Category = Behavior)
+	int32 GetNumQueuedSelections() const { return SelectionQueue.Num() + BypassSelectionQueue.Num(); };
+
+	// Average and max time (seconds) Bases waited for their selection.
+	UFUNCTION(BlueprintPure, Category = Behavior)
+	float GetAverageSelectionWait() const { return NumScheduledSelections > 0 ? (float)(TotalSelectionWait / NumScheduledSelections) : 0.f; };
+
+	UFUNCTION(BlueprintPure, Category = Behavior)
+	float GetMaxSelectionWait() const { return (float)MaxSelectionWait; };
+
+	/**
+	 * Start a new stage: MaxPerStage counters of every Base task in this world are reset.
+	 * O(1): each Base compares the stage epoch when it selects, only Bases sleeping with everything exhausted are woken.
+	 */
+	UFUNCTION(BlueprintCallable, Category = Behavior)
+	void RefreshLevel();
+
+	// Start a new stage for the Base tasks of one agent.
+	UFUNCTION(BlueprintCallable, Category = Behavior)
+	void RefreshAgentLevel(UGameplayTasksComponent* Agent);
+
+	// Changes when the world or Agent stage changes.
+	uint32 GetStageEpoch(const UGameplayTasksComponent* Agent) const;
+
+	// Tick on demand Bases that can't select anything until the next stage.
+	void AddExhaustedBase(UBehavior* Behavior) { ExhaustedBases.Add(Behavior); };
+	void RemoveExhaustedBase(UBehavior* Behavior) { ExhaustedBases.RemoveSingleSwap(Behavior, false); };
+	// Let them check their Behaviors again, e.g. when soft classes were loaded.
+	void WakeExhaustedBases();
+
+	// FinishBehavior of a chain, Base repeats wait until the outermost one is done.
+	void BeginFinishCascade() { FinishCascadeDepth++; };
+	void EndFinishCascade();
+	// Returns false if no cascade is running, the Base repeats at once.
+	bool DeferBaseRepeat(UBehavior* Base);
+
+	// Behaviors that can finish after their interrupt lock was released, finished at the start of the next Tick.
+	void AddPendingFinish(UBehavior* Behavior) { PendingFinishes.AddUnique(Behavior); };
+
+	// Index of BT_Parallel Behaviors, updated when they are initialized in RunBehavior and in OnDestroy.
+	void AddParallelBehavior(UBehavior* Behavior);
+	void RemoveParallelBehavior(UBehavior* Behavior);
+	TArrayView<UBehavior* const> GetParallelBehaviors(const UGameplayTasksComponent* Component) const;
+
+	// Shared selection table of a Base Behavior class, built from the Behaviors of its class defaults.
+	TSharedPtr<const FBehaviorSelectionTable> GetSelectionTable(const UBehavior* Behavior);
+
+	// Restart the seeds given to Base Behaviors, for reproducible selection.
+	UFUNCTION(BlueprintCallable, Category = Behavior)
+	void SetRandomSeed(int32 Seed) { SeedStream.Initialize(Seed); };
+
+	int32 NextBehaviorSeed() { return SeedStream.RandHelper(MAX_int32 - 1) + 1; };
+
+	// Event ring of this world (Behavior.Trace 1 to record, Behavior.TraceDump to save).
+	FBehaviorTrace& GetTrace() { return Trace; };
+
+	// Pool of finished Behaviors used by RunBehavior.
+	UFUNCTION(BlueprintPure, Category = Behavior)
+	UBehaviorPool* GetPool() const { return Pool; };
+
+	// Shared path cache and batched path queries of BehMove.
+	UFUNCTION(BlueprintPure, Category = Behavior)
+	UBehaviorPathService* GetPathService() const { return PathService; };
+
+	// Async loading of soft Behavior classes.
+	UFUNCTION(BlueprintPure, Category = Behavior)
+	UBehaviorClassLoader* GetClassLoader() const { return ClassLoader; };
+
+private:
+	void CompactBuckets();
+
+	UPROPERTY()
+	TArray<FBehaviorTickBucket> Buckets;
+
+	TMap<UClass*, int32> BucketIndices;
+
+	UPROPERTY()
+	UBehaviorPool* Pool;
+
+	UPROPERTY()
+	UBehaviorPathService* PathService;
+
+	UPROPERTY()
+	UBehaviorClassLoader* ClassLoader;
+
+	UPROPERTY()
+	TArray<UBehavior*> PendingFinishes;
+
+	void FlushPendingFinishes();
+
+	// Base repeats requested while Behaviors of this world are finished, started when the outermost FinishBehavior is done.
+	int32 FinishCascadeDepth = 0;
+	TArray<TWeakObjectPtr<UBehavior>> DeferredRepeats;
+
+	void UpdateLOD(float DeltaTime);
+
+	UPROPERTY()
+	TArray<UBehavior*> LODRoots;
+
+	// Player view locations, used by UpdateLOD.
+	TArray<FVector> ViewLocations;
+
+	TArray<TSharedPtr<const FBehaviorLODSettings>> LODSettings;
+
+	void RunSelections();
+	// Take a request from the queue, the Base is added to SelectionBatch if it can select.
+	bool ClaimSelection(const FBehaviorSelectionRequest& Request, double Now);
+	// Prepare SelectionBatch in parallel (UBehavior::PrepareSelection), then apply the decisions on the game thread.
+	void RunSelectionBatch();
+
+	TArray<FBehaviorSelectionRequest> SelectionQueue;
+	TArray<FBehaviorSelectionRequest> BypassSelectionQueue;
+	double TotalSelectionWait = 0.0;
+	double MaxSelectionWait = 0.0;
+	int64 NumScheduledSelections = 0;
+
+	// Only used inside RunSelections, no GC can run while they are filled.
+	TArray<UBehavior*> SelectionBatch;
+	TArray<FBehaviorSelectionDecision> SelectionDecisions;
+
+	// World stage, per-agent stages are added to it.
+	uint32 StageEpoch = 0;
+	TMap<TWeakObjectPtr<UGameplayTasksComponent>, uint32> AgentStageEpochs;
+	// Stale agents are removed when a new one is added past this size.
+	int32 AgentStageEpochsPruneSize = 16;
+
+	UPROPERTY()
+	TArray<UBehavior*> ExhaustedBases;
+
+	UPROPERTY()
+	TMap<UGameplayTasksComponent*, FBehaviorParallelSet> ParallelBehaviors;
+
+	TMap<TWeakObjectPtr<UClass>, TSharedPtr<const FBehaviorSelectionTable>> SelectionTables;
+	FRandomStream SeedStream;
+	FBehaviorTrace Trace;
+
+	int32 NumTicking = 0;
+	int32 NumSleeping = 0;
+	int32 NumTickedLastFrame = 0;
+	double LastTickSeconds = 0.0;
+	bool bIsTicking = false;
+};
@@ -0,0 +1,241 @@
+// (c) XenFFly
+
+#include "BehaviorTrace.h"
+
+#include "BehaviorSubsystem.h"
+#include "Base/Behavior.h"
+#include "Engine/World.h"
+#include "HAL/FileManager.h"
+#include "HAL/IConsoleManager.h"
+#include "Misc/DateTime.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Serialization/Archive.h"
+
+int32 GBehaviorTraceEnabled = 0;
+static FAutoConsoleVariableRef CVarBehaviorTrace(
+	TEXT("Behavior.Trace"),
+	GBehaviorTraceEnabled,
+	TEXT("Record Behavior events into the per-world trace ring (0 - off)."));
+
+static int32 GBehaviorTraceCapacity = 65536;
+static FAutoConsoleVariableRef CVarBehaviorTraceCapacity(
+	TEXT("Behavior.TraceCapacity"),
+	GBehaviorTraceCapacity,
+	TEXT("Number of events kept by the Behavior trace ring (rounded up to a power of two)."));
+
+static const uint32 BehaviorTraceMagic = 0x43525442; // BTRC
+static const int32 BehaviorTraceVersion = 2;
+
+void FBehaviorTrace::Record(EBehaviorTraceEvent Type, const UBehavior* Behavior, uint8 Result, FName FailedCode)
+{
+	if (Buffer.Num() == 0)
+		Buffer.SetNumZeroed(FMath::RoundUpToPowerOfTwo(FMath::Max(GBehaviorTraceCapacity, 1024)));
+
+	const uint64 Index = WriteIndex++;
+	FBehaviorTraceEvent& Event = Buffer[Index & (Buffer.Num() - 1)];
+
+	const AActor* Agent = Behavior->GetOwnerActor();
+	const UBehavior* Parent = Behavior->GetParentBehavior();
+
+	Event.Time = FPlatformTime::Seconds();
+	Event.AgentId = Agent ? Agent->GetUniqueID() : 0;
+	Event.BehaviorId = Behavior->GetUniqueID();
+	Event.ParentId = Parent ? Parent->GetUniqueID() : 0;
+	Event.ClassName = Behavior->GetClass()->GetFName();
+	Event.FailedCode = FailedCode;
+	Event.Type = Type;
+	Event.Result = Result;
+}
+
+void FBehaviorTrace::GetEvents(TArray<FBehaviorTraceEvent>& OutEvents) const
+{
+	OutEvents.Reset();
+	if (Buffer.Num() == 0)
+		return;
+
+	const uint64 End = WriteIndex;
+	const uint64 Start = End > (uint64)Buffer.Num() ? End - Buffer.Num() : 0;
+	OutEvents.Reserve(End - Start);
+	for (uint64 Index = Start; Index < End; Index++)
+		OutEvents.Add(Buffer[Index & (Buffer.Num() - 1)]);
+}
+
+void FBehaviorTrace::Reset()
+{
+	Buffer.Empty();
+	WriteIndex = 0;
+}
+
+bool FBehaviorTrace::SaveToFile(const FString& Filename) const
+{
+	TArray<FBehaviorTraceEvent> Events;
+	GetEvents(Events);
+
+	// Class names are written once, events store their index.
+	TArray<FString> ClassNames;
+	TMap<FName, int32> ClassIndices;
+	for (const FBehaviorTraceEvent& Event : Events)
+		if (!ClassIndices.Contains(Event.ClassName))
+			ClassIndices.Add(Event.ClassName, ClassNames.Add(Event.ClassName.ToString()));
+
+	TUniquePtr<FArchive> Ar(IFileManager::Get().CreateFileWriter(*Filename));
+	if (!Ar)
+		return false;
+
+	uint32 Magic = BehaviorTraceMagic;
+	int32 Version = BehaviorTraceVersion;
+	*Ar << Magic << Version;
+
+	*Ar << ClassNames;
+
+	int32 NumEvents = Events.Num();
+	*Ar << NumEvents;
+	for (FBehaviorTraceEvent& Event : Events)
+	{
+		uint8 Type = (uint8)Event.Type;
+		int32 ClassIndex = ClassIndices.FindChecked(Event.ClassName);
+		FString FailedCode = Event.FailedCode.IsNone() ? FString() : Event.FailedCode.ToString();
+		*Ar << Event.Time << Event.AgentId << Event.BehaviorId << Event.ParentId << ClassIndex << Type << Event.Result << FailedCode;
+	}
+
+	return Ar->Close();
+}
+
+bool FBehaviorTrace::SaveChromeTrace(const FString& Filename) const
+{
+	TArray<FBehaviorTraceEvent> Events;
+	GetEvents(Events);
+
+	return WriteChromeTrace(Events, Filename);
+}
+
+bool FBehaviorTrace::ConvertToChromeTrace(const FString& TraceFilename, const FString& JsonFilename)
+{
+	TUniquePtr<FArchive> Ar(IFileManager::Get().CreateFileReader(*TraceFilename));
+	if (!Ar)
+		return false;
+
+	uint32 Magic = 0;
+	int32 Version = 0;
+	*Ar << Magic << Version;
+	if (Magic != BehaviorTraceMagic || Version != BehaviorTraceVersion)
+		return false;
+
+	TArray<FString> ClassNames;
+	*Ar << ClassNames;
+
+	TArray<FBehaviorTraceEvent> Events;
+	int32 NumEvents = 0;
+	*Ar << NumEvents;
+	Events.Reserve(FMath::Max(NumEvents, 0));
+	for (int32 i = 0; i < NumEvents && !Ar->IsError(); i++)
+	{
+		FBehaviorTraceEvent& Event = Events.AddZeroed_GetRef();
+		uint8 Type = 0;
+		int32 ClassIndex = INDEX_NONE;
+		FString FailedCode;
+		*Ar << Event.Time << Event.AgentId << Event.BehaviorId << Event.ParentId << ClassIndex << Type << Event.Result << FailedCode;
+		Event.Type = (EBehaviorTraceEvent)Type;
+		Event.ClassName = ClassNames.IsValidIndex(ClassIndex) ? FName(*ClassNames[ClassIndex]) : NAME_None;
+		Event.FailedCode = FailedCode.IsEmpty() ? NAME_None : FName(*FailedCode);
+	}
+
+	return !Ar->IsError() && WriteChromeTrace(Events, JsonFilename);
+}
+
+// Class names and failure codes can contain any character.
+static FString EscapeJsonString(const FString& String)
+{
+	FString Escaped;
+	Escaped.Reserve(String.Len());
+	for (TCHAR Char : String)
+	{
+		if (Char == TEXT('"') || Char == TEXT('\\'))
+		{
+			Escaped.AppendChar(TEXT('\\'));
+			Escaped.AppendChar(Char);
+		}
+		else if (Char < 0x20)
+			Escaped += FString::Printf(TEXT("\\u%04x"), (uint32)Char);
+		else Escaped.AppendChar(Char);
+	}
+	return Escaped;
+}
+
+bool FBehaviorTrace::WriteChromeTrace(const TArray<FBehaviorTraceEvent>& Events, const FString& Filename)
+{
+	static const TCHAR* EventNames[] = { TEXT("Run"), TEXT("Queue"), TEXT("Activate"), TEXT("Finish"), TEXT("Destroy"), TEXT("Interrupt"), TEXT("Resume") };
+	static const TCHAR* ResultNames[] = { TEXT("Success"), TEXT("Failed"), TEXT("Skipped") };
+
+	const double StartTime = Events.Num() > 0 ? Events[0].Time : 0.0;
+
+	FString Json = TEXT("{\"traceEvents\":[\n");
+	for (int32 i = 0; i < Events.Num(); i++)
+	{
+		const FBehaviorTraceEvent& Event = Events[i];
+		const double Timestamp = (Event.Time - StartTime) * 1e6;
+
+		// Activate..Destroy is an async slice per Behavior (parallel Behaviors don't nest), the rest are instants.
+		const TCHAR* Phase = Event.Type == EBehaviorTraceEvent::Activate ? TEXT("b") : Event.Type == EBehaviorTraceEvent::Destroy ? TEXT("e") : TEXT("n");
+
+		Json += FString::Printf(
+			TEXT("%s{\"name\":\"%s\",\"cat\":\"behavior\",\"ph\":\"%s\",\"id\":%u,\"ts\":%.3f,\"pid\":%u,\"tid\":%u,\"args\":{\"event\":\"%s\",\"parent\":%u,\"result\":\"%s\",\"code\":\"%s\"}}"),
+			i > 0 ? TEXT(",\n") : TEXT(""),
+			Event.ClassName.IsNone() ? TEXT("?") : *EscapeJsonString(Event.ClassName.ToString()),
+			Phase,
+			Event.BehaviorId,
+			Timestamp,
+			Event.AgentId,
+			Event.AgentId,
+			EventNames[FMath::Min<uint8>((uint8)Event.Type, (uint8)(UE_ARRAY_COUNT(EventNames) - 1))],
+			Event.ParentId,
+			Event.Result == NoResult ? TEXT("None") : ResultNames[FMath::Min<uint8>(Event.Result, (uint8)(UE_ARRAY_COUNT(ResultNames) - 1))],
+			Event.FailedCode.IsNone() ? TEXT("") : *EscapeJsonString(Event.FailedCode.ToString()));
+	}
+	Json += TEXT("\n]}\n");
+
+	return FFileHelper::SaveStringToFile(Json, *Filename);
+}
+
+static FString GetTraceFilename(const TArray<FString>& Args, const TCHAR* Extension)
+{
+	if (Args.Num() > 0)
+		return Args[0];
+
+	return FPaths::ProfilingDir() / FString::Printf(TEXT("BehaviorTrace-%s.%s"), *FDateTime::Now().ToString(), Extension);
+}
+
+static void DumpBehaviorTrace(const TArray<FString>& Args, UWorld* World, bool bChrome)
+{
+	UBehaviorSubsystem* Subsystem = World ? World->GetSubsystem<UBehaviorSubsystem>() : nullptr;
+	if (!Subsystem)
+		return;
+
+	const FString Filename = GetTraceFilename(Args, bChrome ? TEXT("json") : TEXT("btrace"));
+	const bool bSaved = bChrome ? Subsystem->GetTrace().SaveChromeTrace(Filename) : Subsystem->GetTrace().SaveToFile(Filename);
+	UE_LOG(LogBehavior, Display, TEXT("Behavior trace %s: %s"), bSaved ? TEXT("saved") : TEXT("NOT saved"), *Filename);
+}
+
+static FAutoConsoleCommandWithWorldAndArgs BehaviorTraceDumpCommand(
+	TEXT("Behavior.TraceDump"),
+	TEXT("Save the Behavior trace ring of this world (binary). Args: [Filename]"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([](const TArray<FString>& Args, UWorld* World) { DumpBehaviorTrace(Args, World, false); }));
+
+static FAutoConsoleCommandWithWorldAndArgs BehaviorTraceDumpChromeCommand(
+	TEXT("Behavior.TraceDumpChrome"),
+	TEXT("Save the Behavior trace ring of this world as a Chrome trace. Args: [Filename]"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([](const TArray<FString>& Args, UWorld* World) { DumpBehaviorTrace(Args, World, true); }));
+
+static FAutoConsoleCommand BehaviorTraceConvertCommand(
+	TEXT("Behavior.TraceConvert"),
+	TEXT("Convert a binary Behavior trace to a Chrome trace. Args: <Trace.btrace> [Trace.json]"),
+	FConsoleCommandWithArgsDelegate::CreateLambda([](const TArray<FString>& Args)
+	{
+		if (Args.Num() == 0)
+			return;
+
+		const FString JsonFilename = Args.Num() > 1 ? Args[1] : FPaths::ChangeExtension(Args[0], TEXT("json"));
+		const bool bSaved = FBehaviorTrace::ConvertToChromeTrace(Args[0], JsonFilename);
+		UE_LOG(LogBehavior, Display, TEXT("Behavior trace %s: %s"), bSaved ? TEXT("converted") : TEXT("NOT converted"), *JsonFilename);
+	}));
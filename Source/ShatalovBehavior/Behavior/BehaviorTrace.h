@@ -0,0 +1,65 @@
+// (c) XenFFly
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+class UBehavior;
+
+// Behavior.Trace console variable, read on every event.
+extern SHATALOVBEHAVIOR_API int32 GBehaviorTraceEnabled;
+
+enum class EBehaviorTraceEvent : uint8
+{
+	Run,		// RunBehavior started the Behavior
+	Queue,		// RunBehavior put the Behavior in TaskQueue
+	Activate,
+	Finish,		// FinishBehavior (Result, FailedCode)
+	Destroy,	// OnDestroy
+	Interrupt,	// SetIsInterrupted(true)
+	Resume		// SetIsInterrupted(false)
+};
+
+struct FBehaviorTraceEvent
+{
+	double Time;
+	uint32 AgentId;
+	uint32 BehaviorId;
+	uint32 ParentId;
+	// Resolved when recorded, the class can be gone by the time the ring is saved.
+	FName ClassName;
+	FName FailedCode;
+	EBehaviorTraceEvent Type;
+	// EBehaviorResult of Finish and Destroy, FBehaviorTrace::NoResult for the other events.
+	uint8 Result;
+};
+
+/**
+ * Fixed-size ring of Behavior events for one world, allocated by the first event.
+ * Game thread only, nothing is recorded while Behavior.Trace is 0.
+ */
+class SHATALOVBEHAVIOR_API FBehaviorTrace
+{
+public:
+	static constexpr uint8 NoResult = 0xFF;
+
+	static bool IsEnabled() { return GBehaviorTraceEnabled != 0; };
+
+	void Record(EBehaviorTraceEvent Type, const UBehavior* Behavior, uint8 Result = NoResult, FName FailedCode = NAME_None);
+
+	// Copy of the recorded events, oldest first.
+	void GetEvents(TArray<FBehaviorTraceEvent>& OutEvents) const;
+	void Reset();
+
+	// Binary dump (.btrace), can be converted later with ConvertToChromeTrace.
+	bool SaveToFile(const FString& Filename) const;
+	// Chrome trace / Perfetto JSON (chrome://tracing), one process per agent.
+	bool SaveChromeTrace(const FString& Filename) const;
+	static bool ConvertToChromeTrace(const FString& TraceFilename, const FString& JsonFilename);
+
+private:
+	static bool WriteChromeTrace(const TArray<FBehaviorTraceEvent>& Events, const FString& Filename);
+
+	TArray<FBehaviorTraceEvent> Buffer;
+	uint64 WriteIndex = 0;
+};
@@ -21,6 +21,7 @@ void ABehaviorOwner::BeginPlay()
 		GameplayTasksComp->RegisterComponent();
 	}
 	Behavior = UBehavior::NewTask<UBehavior>(GameplayTasksComp);
+	Behavior->SetLODSettings(BehaviorLOD);
 	Behavior->ReadyForActivation();
 }
 
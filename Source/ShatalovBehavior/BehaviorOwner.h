@@ -4,6 +4,7 @@
 
 #include "CoreMinimal.h"
 #include "GameFramework/Actor.h"
+#include "Behavior/BehaviorLOD.h"
 #include "BehaviorOwner.generated.h"
 
 UCLASS()
@@ -25,4 +26,8 @@ public:
 
 	UPROPERTY(EditAnywhere, BlueprintReadWrite)
 		class UBehavior* Behavior;
+
+	// Given to the first Behavior before activation (SetLODSettings).
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+		FBehaviorLODSettings BehaviorLOD;
 };
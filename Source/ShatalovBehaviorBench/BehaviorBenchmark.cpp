@@ -0,0 +1,676 @@
+// (c) XenFFly
+
+#include "CoreMinimal.h"
+#include "Animation/AnimInstance.h"
+#include "Animation/AnimMontage.h"
+#include "Components/SkeletalMeshComponent.h"
+#include "Engine/Engine.h"
+#include "Engine/World.h"
+#include "EngineUtils.h"
+#include "GameFramework/Character.h"
+#include "HAL/IConsoleManager.h"
+#include "HAL/MemoryBase.h"
+#include "Misc/App.h"
+#include "Misc/DateTime.h"
+#include "Misc/EngineVersion.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Tickable.h"
+#include "UObject/UObjectArray.h"
+#include "BehaviorOwner.h"
+#include "BenchmarkBehaviors.h"
+#include "Behavior/BehaviorSubsystem.h"
+#include "Behavior/Base/Behavior.h"
+
+namespace BehaviorBenchmark
+{
+	// The lookups as they were before the hierarchy was cached.
+	UBehavior* BaselineParent(UBehavior* Behavior)
+	{
+		UObject* TaskOwner = Cast<UObject>(Behavior->GetTaskOwner());
+		if (IsValid(TaskOwner) && TaskOwner->IsA(UBehavior::StaticClass()))
+			return Cast<UBehavior>(TaskOwner);
+		else return nullptr;
+	}
+
+	UBehavior* BaselineChild(UBehavior* Behavior)
+	{
+		return Cast<UBehavior>(Behavior->GetChildTask());
+	}
+
+	UBehavior* BaselineOwner(UBehavior* Behavior)
+	{
+		if (IsValid(BaselineParent(Behavior)))
+			return BaselineParent(Behavior);
+		else if (Behavior->BehaviorIsOwnedByTasksComponent())
+			return Behavior;
+		else return nullptr;
+	}
+
+	UBehavior* BaselineLast(UBehavior* Behavior)
+	{
+		if (IsValid(BaselineChild(Behavior)))
+			return BaselineLast(BaselineChild(Behavior));
+		else return Behavior;
+	}
+
+	// GetRootBehavior had no baseline, walking the parents is what a caller would have done
+	UBehavior* WalkRoot(UBehavior* Behavior)
+	{
+		UBehavior* Node = Behavior;
+		while (IsValid(BaselineParent(Node)))
+			Node = BaselineParent(Node);
+		return Node;
+	}
+
+	// Nanoseconds per call
+	template<typename TFunc>
+	double TimePerCall(int32 Iterations, TFunc&& Func)
+	{
+		const double StartTime = FPlatformTime::Seconds();
+		for (int32 i = 0; i < Iterations; i++)
+			Func();
+		return (FPlatformTime::Seconds() - StartTime) * 1e9 / FMath::Max(Iterations, 1);
+	}
+
+	// Behavior.BenchHierarchy [Depth] [Iterations]
+	void BenchHierarchy(const TArray<FString>& Args, UWorld* World)
+	{
+		const int32 ChainDepth = Args.Num() > 0 ? FCString::Atoi(*Args[0]) : 10;
+		const int32 Iterations = Args.Num() > 1 ? FCString::Atoi(*Args[1]) : 100000;
+
+		ABehaviorOwner* Owner = World ? World->SpawnActor<ABehaviorOwner>() : nullptr;
+		if (!Owner || !Owner->Behavior)
+		{
+			UE_LOG(LogBehavior, Error, TEXT("BenchHierarchy: can't spawn ABehaviorOwner (the world must be playing)."));
+			return;
+		}
+
+		UBehavior* Root = Owner->Behavior;
+		UBehavior* Leaf = Root;
+		for (int32 i = 0; i < ChainDepth && Leaf; i++)
+			Leaf = Leaf->RunBehavior(UBehavior::StaticClass());
+
+		if (!Leaf)
+		{
+			UE_LOG(LogBehavior, Error, TEXT("BenchHierarchy: can't build the chain."));
+			Owner->Destroy();
+			return;
+		}
+
+		// Keep the results alive
+		UPTRINT Sink = 0;
+
+		const double BaselineOwnerTime = TimePerCall(Iterations, [&]() { Sink ^= (UPTRINT)BaselineOwner(Leaf); });
+		const double CachedOwnerTime = TimePerCall(Iterations, [&]() { Sink ^= (UPTRINT)Leaf->GetBehaviorOwner(); });
+		const double BaselineLastTime = TimePerCall(Iterations, [&]() { Sink ^= (UPTRINT)BaselineLast(Root); });
+		const double CachedLastTime = TimePerCall(Iterations, [&]() { Sink ^= (UPTRINT)Root->GetLastBehavior(); });
+		const double BaselineParentTime = TimePerCall(Iterations, [&]() { Sink ^= (UPTRINT)BaselineParent(Leaf); });
+		const double CachedParentTime = TimePerCall(Iterations, [&]() { Sink ^= (UPTRINT)Leaf->GetParentBehavior(); });
+		const double WalkRootTime = TimePerCall(Iterations, [&]() { Sink ^= (UPTRINT)WalkRoot(Leaf); });
+		const double CachedRootTime = TimePerCall(Iterations, [&]() { Sink ^= (UPTRINT)Leaf->GetRootBehavior(); });
+
+		UE_LOG(LogBehavior, Display, TEXT("BenchHierarchy: depth %d, %d iterations (ns per call, baseline / cached)"), Leaf->GetBehaviorDepth(), Iterations);
+		UE_LOG(LogBehavior, Display, TEXT("  GetBehaviorOwner: %.2f / %.2f"), BaselineOwnerTime, CachedOwnerTime);
+		UE_LOG(LogBehavior, Display, TEXT("  GetLastBehavior:  %.2f / %.2f"), BaselineLastTime, CachedLastTime);
+		UE_LOG(LogBehavior, Display, TEXT("  GetParentBehavior: %.2f / %.2f"), BaselineParentTime, CachedParentTime);
+		UE_LOG(LogBehavior, Display, TEXT("  GetRootBehavior (parent walk): %.2f / %.2f"), WalkRootTime, CachedRootTime);
+		UE_LOG(LogBehavior, Verbose, TEXT("  (%llu)"), (uint64)Sink);
+
+		Owner->Destroy();
+	}
+
+	static FAutoConsoleCommandWithWorldAndArgs BenchHierarchyCommand(
+		TEXT("Behavior.BenchHierarchy"),
+		TEXT("Time cached hierarchy lookups against the baseline implementations on a deep chain. Args: [Depth=10] [Iterations=100000]"),
+		FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&BenchHierarchy));
+
+	// Behavior.BenchFinish [Depth] [Agents]
+	void BenchFinish(const TArray<FString>& Args, UWorld* World)
+	{
+		const int32 ChainDepth = Args.Num() > 0 ? FCString::Atoi(*Args[0]) : 32;
+		const int32 NumAgents = Args.Num() > 1 ? FCString::Atoi(*Args[1]) : 1000;
+
+		TArray<ABehaviorOwner*> Owners;
+		TArray<UBehavior*> Chains;
+		for (int32 i = 0; i < NumAgents && World; i++)
+		{
+			ABehaviorOwner* Owner = World->SpawnActor<ABehaviorOwner>();
+			if (!Owner || !Owner->Behavior)
+				break;
+			Owners.Add(Owner);
+
+			UBehavior* Leaf = Owner->Behavior;
+			for (int32 Level = 0; Level < ChainDepth && Leaf; Level++)
+				Leaf = Leaf->RunBehavior(UBehavior::StaticClass());
+			if (Owner->Behavior->GetChildBehavior())
+				Chains.Add(Owner->Behavior->GetChildBehavior());
+		}
+
+		if (Chains.Num() == 0)
+		{
+			UE_LOG(LogBehavior, Error, TEXT("BenchFinish: can't spawn ABehaviorOwner (the world must be playing)."));
+		}
+		else
+		{
+			// Abort every chain below the first Behavior
+			const double StartTime = FPlatformTime::Seconds();
+			for (UBehavior* Chain : Chains)
+				Chain->FinishBehavior(BR_Skipped);
+			const double TotalTime = FPlatformTime::Seconds() - StartTime;
+
+			UE_LOG(LogBehavior, Display, TEXT("BenchFinish: %d chains of depth %d aborted in %.3f ms (%.2f us per chain, %.1f ns per Behavior)"),
+				Chains.Num(), ChainDepth, TotalTime * 1e3, TotalTime * 1e6 / Chains.Num(), TotalTime * 1e9 / (Chains.Num() * FMath::Max(ChainDepth, 1)));
+		}
+
+		for (ABehaviorOwner* Owner : Owners)
+			Owner->Destroy();
+	}
+
+	static FAutoConsoleCommandWithWorldAndArgs BenchFinishCommand(
+		TEXT("Behavior.BenchFinish"),
+		TEXT("Time aborting deep Behavior chains on many agents. Args: [Depth=32] [Agents=1000]"),
+		FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&BenchFinish));
+
+	// Behavior.BenchAnim <Animation> [Slot] [Iterations]
+	void BenchAnim(const TArray<FString>& Args, UWorld* World)
+	{
+		UAnimSequenceBase* Animation = Args.Num() > 0 ? LoadObject<UAnimSequenceBase>(nullptr, *Args[0]) : nullptr;
+		const FName SlotName = Args.Num() > 1 ? FName(*Args[1]) : FName(TEXT("DefaultSlot"));
+		const int32 Iterations = Args.Num() > 2 ? FMath::Max(FCString::Atoi(*Args[2]), 1) : 10;
+		if (!Animation || !World)
+		{
+			UE_LOG(LogBehavior, Error, TEXT("BenchAnim: usage Behavior.BenchAnim /Game/Path/Anim.Anim [Slot=DefaultSlot] [Iterations=10]"));
+			return;
+		}
+
+		// Characters of the level that use an Animation Blueprint
+		TArray<USkeletalMeshComponent*> Meshes;
+		for (TActorIterator<ACharacter> It(World); It; ++It)
+		{
+			USkeletalMeshComponent* Mesh = It->GetMesh();
+			if (Mesh && Mesh->GetAnimationMode() == EAnimationMode::AnimationBlueprint && Mesh->GetAnimInstance())
+				Meshes.Add(Mesh);
+		}
+
+		if (Meshes.Num() == 0)
+		{
+			UE_LOG(LogBehavior, Error, TEXT("BenchAnim: no Characters with an Animation Blueprint in the world."));
+			return;
+		}
+
+		// Single node mode: PlayAnimation replaces the AnimInstance, SetAnimationMode creates the Animation Blueprint instance again.
+		double StartTime = FPlatformTime::Seconds();
+		for (int32 i = 0; i < Iterations; i++)
+			for (USkeletalMeshComponent* Mesh : Meshes)
+			{
+				Mesh->PlayAnimation(Animation, false);
+				Mesh->SetAnimationMode(EAnimationMode::AnimationBlueprint);
+			}
+		const double SingleNodeTime = FPlatformTime::Seconds() - StartTime;
+
+		// Slot: the montage plays on the existing AnimInstance.
+		StartTime = FPlatformTime::Seconds();
+		for (int32 i = 0; i < Iterations; i++)
+			for (USkeletalMeshComponent* Mesh : Meshes)
+			{
+				UAnimInstance* AnimInstance = Mesh->GetAnimInstance();
+				if (UAnimMontage* Montage = AnimInstance->PlaySlotAnimationAsDynamicMontage(Animation, SlotName, 0.f, 0.f))
+					AnimInstance->Montage_Stop(0.f, Montage);
+			}
+		const double SlotTime = FPlatformTime::Seconds() - StartTime;
+
+		const int32 NumCalls = Iterations * Meshes.Num();
+		UE_LOG(LogBehavior, Display, TEXT("BenchAnim: %d meshes x %d, single node + reset %.2f us per play, slot montage %.2f us per play (x%.1f)"),
+			Meshes.Num(), Iterations, SingleNodeTime * 1e6 / NumCalls, SlotTime * 1e6 / NumCalls, SingleNodeTime / FMath::Max(SlotTime, 1e-9));
+	}
+
+	static FAutoConsoleCommandWithWorldAndArgs BenchAnimCommand(
+		TEXT("Behavior.BenchAnim"),
+		TEXT("Time playing an animation in single node mode (AnimInstance reinit) vs in a slot on Characters of the world. Args: <Animation> [Slot=DefaultSlot] [Iterations=10]"),
+		FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&BenchAnim));
+
+	/**
+	 * Counts calls into GMalloc from every thread while installed. Stays alive after Uninstall, so a thread
+	 * that read GMalloc just before the swap still reaches the wrapped allocator.
+	 */
+	class FMallocCounter : public FMalloc
+	{
+	public:
+		void Install()
+		{
+			if (!Inner)
+				Inner = GMalloc;
+			if (GMalloc == Inner)
+				GMalloc = this;
+		}
+
+		void Uninstall()
+		{
+			if (GMalloc == this)
+				GMalloc = Inner;
+		}
+
+		int64 GetNumAllocations() const { return NumAllocations.Load(EMemoryOrder::Relaxed); };
+		int64 GetAllocatedBytes() const { return AllocatedBytes.Load(EMemoryOrder::Relaxed); };
+
+		virtual void* Malloc(SIZE_T Count, uint32 Alignment) override
+		{
+			CountAllocation(Count);
+			return Inner->Malloc(Count, Alignment);
+		}
+
+		virtual void* TryMalloc(SIZE_T Count, uint32 Alignment) override
+		{
+			CountAllocation(Count);
+			return Inner->TryMalloc(Count, Alignment);
+		}
+
+		virtual void* Realloc(void* Original, SIZE_T Count, uint32 Alignment) override
+		{
+			// Growing in place still costs a call, count it like a new block
+			CountAllocation(Count);
+			return Inner->Realloc(Original, Count, Alignment);
+		}
+
+		virtual void* TryRealloc(void* Original, SIZE_T Count, uint32 Alignment) override
+		{
+			CountAllocation(Count);
+			return Inner->TryRealloc(Original, Count, Alignment);
+		}
+
+		virtual void Free(void* Original) override { Inner->Free(Original); };
+		virtual SIZE_T QuantizeSize(SIZE_T Count, uint32 Alignment) override { return Inner->QuantizeSize(Count, Alignment); };
+		virtual bool GetAllocationSize(void* Original, SIZE_T& SizeOut) override { return Inner->GetAllocationSize(Original, SizeOut); };
+		virtual void Trim(bool bTrimThreadCaches) override { Inner->Trim(bTrimThreadCaches); };
+		virtual void SetupTLSCachesOnCurrentThread() override { Inner->SetupTLSCachesOnCurrentThread(); };
+		virtual void ClearAndDisableTLSCachesOnCurrentThread() override { Inner->ClearAndDisableTLSCachesOnCurrentThread(); };
+		virtual void InitializeStatsMetadata() override { Inner->InitializeStatsMetadata(); };
+		virtual void UpdateStats() override { Inner->UpdateStats(); };
+		virtual void GetAllocatorStats(FGenericMemoryStats& OutStats) override { Inner->GetAllocatorStats(OutStats); };
+		virtual void DumpAllocatorStats(FOutputDevice& Ar) override { Inner->DumpAllocatorStats(Ar); };
+		virtual bool IsInternallyThreadSafe() const override { return Inner->IsInternallyThreadSafe(); };
+		virtual bool ValidateHeap() override { return Inner->ValidateHeap(); };
+		virtual const TCHAR* GetDescriptiveName() override { return Inner->GetDescriptiveName(); };
+
+	private:
+		void CountAllocation(SIZE_T Count)
+		{
+			NumAllocations.IncrementExchange();
+			AllocatedBytes.AddExchange((int64)Count);
+		}
+
+		FMalloc* Inner = nullptr;
+		TAtomic<int64> NumAllocations { 0 };
+		TAtomic<int64> AllocatedBytes { 0 };
+	};
+
+	static FMallocCounter MallocCounter;
+
+	struct FScenarioResult
+	{
+		EBehaviorBenchScenario Scenario = EBehaviorBenchScenario::Override;
+		int32 NumAgents = 0;
+		int32 NumFrames = 0;
+		int32 NumBehaviors = 0;
+		double FrameMs = 0.0, FrameP95Ms = 0.0, FrameMaxMs = 0.0;
+		double BehaviorTickMs = 0.0;
+		double TickedPerFrame = 0.0;
+		int64 ObjectsCreated = 0;
+		int64 Allocations = 0;
+		int64 AllocatedKb = 0;
+		double GcMs = 0.0;
+		int32 NumGc = 0;
+		double TeardownGcMs = 0.0;
+	};
+
+	struct FBenchSettings
+	{
+		TArray<EBehaviorBenchScenario> Scenarios;
+		TArray<int32> Agents;
+		int32 WarmupFrames = 60;
+		int32 Frames = 300;
+		int32 FanOut = 4;
+		int32 ChainDepth = 16;
+		bool bQuit = false;
+		FString Filename;
+	};
+
+	/**
+	 * Runs every scenario at every agent count over real frames, so the numbers include the engine tick,
+	 * timers and GC. Warmup frames fill the pools before measuring. Allocations are counted by MallocCounter
+	 * on every thread; the teardown GC is requested from the engine and runs in its own slot of the next world tick.
+	 */
+	class FBenchRunner : public FTickableGameObject, public FUObjectArray::FUObjectCreateListener
+	{
+	public:
+		FBenchRunner(UWorld* InWorld, const FBenchSettings& InSettings)
+			: World(InWorld), Settings(InSettings)
+		{
+			for (EBehaviorBenchScenario Scenario : Settings.Scenarios)
+				for (int32 NumAgents : Settings.Agents)
+					Cases.Add({ Scenario, NumAgents });
+
+			MallocCounter.Install();
+			GUObjectArray.AddUObjectCreateListener(this);
+			PreGcHandle = FCoreUObjectDelegates::GetPreGarbageCollectDelegate().AddRaw(this, &FBenchRunner::OnPreGarbageCollect);
+			PostGcHandle = FCoreUObjectDelegates::GetPostGarbageCollect().AddRaw(this, &FBenchRunner::OnPostGarbageCollect);
+		}
+
+		virtual ~FBenchRunner()
+		{
+			StopListening();
+		}
+
+		bool IsDone() const { return bDone; };
+
+		virtual void Tick(float DeltaTime) override
+		{
+			if (bDone)
+				return;
+
+			const double Now = FPlatformTime::Seconds();
+			const double FrameSeconds = Now - LastFrameTime;
+			LastFrameTime = Now;
+
+			UBehaviorSubsystem* Subsystem = World.IsValid() ? World->GetSubsystem<UBehaviorSubsystem>() : nullptr;
+			if (!Subsystem)
+			{
+				UE_LOG(LogBehavior, Error, TEXT("Bench: the world is gone."));
+				Finish();
+				return;
+			}
+
+			switch (Phase)
+			{
+			case EPhase::Setup:
+				SpawnAgents();
+				Frame = 0;
+				Phase = EPhase::Warmup;
+				break;
+			case EPhase::Warmup:
+				if (++Frame >= Settings.WarmupFrames)
+				{
+					Result = FScenarioResult();
+					Result.Scenario = Cases[CaseIndex].Key;
+					Result.NumAgents = Agents.Num();
+					FrameTimes.Reset();
+					NumObjectsCreated = 0;
+					StartAllocations = MallocCounter.GetNumAllocations();
+					StartAllocatedBytes = MallocCounter.GetAllocatedBytes();
+					Frame = 0;
+					Phase = EPhase::Measure;
+					bMeasuring = true;
+				}
+				break;
+			case EPhase::Measure:
+				FrameTimes.Add(FrameSeconds * 1000.0);
+				Result.BehaviorTickMs += Subsystem->GetLastTickSeconds() * 1000.0;
+				Result.TickedPerFrame += Subsystem->GetNumTickedLastFrame();
+				if (++Frame >= Settings.Frames)
+				{
+					bMeasuring = false;
+					Result.NumBehaviors = Subsystem->GetNumTickingBehaviors() + Subsystem->GetNumSleepingBehaviors();
+					Result.ObjectsCreated = NumObjectsCreated;
+					Result.Allocations = MallocCounter.GetNumAllocations() - StartAllocations;
+					Result.AllocatedKb = (MallocCounter.GetAllocatedBytes() - StartAllocatedBytes) / 1024;
+					EndCase();
+				}
+				break;
+			case EPhase::Teardown:
+				if (bTeardownGcDone)
+					NextCase();
+				break;
+			}
+		}
+
+		virtual TStatId GetStatId() const override { RETURN_QUICK_DECLARE_CYCLE_STAT(FBehaviorBenchRunner, STATGROUP_Tickables); };
+		virtual ETickableTickType GetTickableTickType() const override { return ETickableTickType::Always; };
+		virtual UWorld* GetTickableGameObjectWorld() const override { return World.Get(); };
+
+		virtual void NotifyUObjectCreated(const UObjectBase* Object, int32 Index) override
+		{
+			if (bMeasuring)
+				NumObjectsCreated++;
+		}
+		virtual void OnUObjectArrayShutdown() override { StopListening(); };
+
+	private:
+		enum class EPhase : uint8 { Setup, Warmup, Measure, Teardown };
+
+		void SpawnAgents()
+		{
+			const TPair<EBehaviorBenchScenario, int32>& Case = Cases[CaseIndex];
+			for (int32 i = 0; i < Case.Value; i++)
+			{
+				ABehaviorOwner* Owner = World->SpawnActor<ABehaviorOwner>();
+				if (!Owner || !Owner->Behavior)
+					continue;
+				Agents.Add(Owner);
+
+				if (Case.Key == EBehaviorBenchScenario::Base)
+				{
+					Owner->Behavior->RunBehavior(UBenchBase::StaticClass());
+					continue;
+				}
+
+				UBenchDriver* Driver = Cast<UBenchDriver>(Owner->Behavior->RunBehavior(UBenchDriver::StaticClass(), false));
+				if (!Driver)
+					continue;
+				Driver->Scenario = Case.Key;
+				Driver->FanOut = Settings.FanOut;
+				Driver->ChainDepth = Settings.ChainDepth;
+				Driver->Ready();
+			}
+		}
+
+		void StopListening()
+		{
+			if (!bListening)
+				return;
+			bListening = false;
+			MallocCounter.Uninstall();
+			GUObjectArray.RemoveUObjectCreateListener(this);
+			FCoreUObjectDelegates::GetPreGarbageCollectDelegate().Remove(PreGcHandle);
+			FCoreUObjectDelegates::GetPostGarbageCollect().Remove(PostGcHandle);
+		}
+
+		void DestroyAgents()
+		{
+			for (TWeakObjectPtr<ABehaviorOwner>& Agent : Agents)
+				if (Agent.IsValid())
+					Agent->Destroy();
+			Agents.Reset();
+		}
+
+		void EndCase()
+		{
+			DestroyAgents();
+
+			Result.NumFrames = FrameTimes.Num();
+			if (FrameTimes.Num() > 0)
+			{
+				FrameTimes.Sort();
+				double Sum = 0.0;
+				for (double Time : FrameTimes)
+					Sum += Time;
+				Result.FrameMs = Sum / FrameTimes.Num();
+				Result.FrameP95Ms = FrameTimes[FMath::Min(FMath::FloorToInt(FrameTimes.Num() * 0.95), FrameTimes.Num() - 1)];
+				Result.FrameMaxMs = FrameTimes.Last();
+				Result.BehaviorTickMs /= FrameTimes.Num();
+				Result.TickedPerFrame /= FrameTimes.Num();
+			}
+
+			// Full purge of the destroyed agents, timed by OnPostGarbageCollect
+			bTeardownGcDone = false;
+			GEngine->ForceGarbageCollection(true);
+			Phase = EPhase::Teardown;
+		}
+
+		void NextCase()
+		{
+			UE_LOG(LogBehavior, Display, TEXT("Bench %s x%d: frame %.3f ms (p95 %.3f), behavior tick %.3f ms, %lld allocations, %d objects created, gc %.3f ms, teardown gc %.3f ms"),
+				*GetScenarioName(Result.Scenario), Result.NumAgents, Result.FrameMs, Result.FrameP95Ms, Result.BehaviorTickMs, Result.Allocations, (int32)Result.ObjectsCreated, Result.GcMs, Result.TeardownGcMs);
+
+			Results.Add(Result);
+			Phase = EPhase::Setup;
+			if (++CaseIndex >= Cases.Num())
+				Finish();
+		}
+
+		void Finish()
+		{
+			bDone = true;
+			bMeasuring = false;
+			DestroyAgents();
+			StopListening();
+			WriteResults();
+
+			if (Settings.bQuit)
+				FPlatformMisc::RequestExit(false);
+		}
+
+		void WriteResults() const
+		{
+			FString Json = FString::Printf(TEXT("{\"engine\":\"%s\",\"config\":\"%s\",\"fixedTimeStep\":%s,\"warmupFrames\":%d,\"results\":[\n"),
+				*FEngineVersion::Current().ToString(),
+				LexToString(FApp::GetBuildConfiguration()),
+				FApp::UseFixedTimeStep() ? TEXT("true") : TEXT("false"),
+				Settings.WarmupFrames);
+
+			for (int32 i = 0; i < Results.Num(); i++)
+			{
+				const FScenarioResult& Entry = Results[i];
+				Json += FString::Printf(
+					TEXT("%s{\"scenario\":\"%s\",\"agents\":%d,\"behaviors\":%d,\"frames\":%d,\"frameMs\":%.4f,\"frameP95Ms\":%.4f,\"frameMaxMs\":%.4f,")
+					TEXT("\"behaviorTickMs\":%.4f,\"tickedPerFrame\":%.1f,\"usPerBehaviorTick\":%.4f,\"objectsCreated\":%lld,")
+					TEXT("\"allocations\":%lld,\"allocationsPerFrame\":%.1f,\"allocatedKb\":%lld,\"gcMs\":%.4f,\"gcCount\":%d,\"teardownGcMs\":%.4f}"),
+					i > 0 ? TEXT(",\n") : TEXT(""),
+					*GetScenarioName(Entry.Scenario),
+					Entry.NumAgents,
+					Entry.NumBehaviors,
+					Entry.NumFrames,
+					Entry.FrameMs,
+					Entry.FrameP95Ms,
+					Entry.FrameMaxMs,
+					Entry.BehaviorTickMs,
+					Entry.TickedPerFrame,
+					Entry.TickedPerFrame > 0.0 ? Entry.BehaviorTickMs * 1000.0 / Entry.TickedPerFrame : 0.0,
+					Entry.ObjectsCreated,
+					Entry.Allocations,
+					Entry.NumFrames > 0 ? (double)Entry.Allocations / Entry.NumFrames : 0.0,
+					Entry.AllocatedKb,
+					Entry.GcMs,
+					Entry.NumGc,
+					Entry.TeardownGcMs);
+			}
+			Json += TEXT("\n]}\n");
+
+			const bool bSaved = FFileHelper::SaveStringToFile(Json, *Settings.Filename);
+			UE_LOG(LogBehavior, Display, TEXT("Bench results %s: %s"), bSaved ? TEXT("saved") : TEXT("NOT saved"), *Settings.Filename);
+		}
+
+		void OnPreGarbageCollect() { GcStartTime = FPlatformTime::Seconds(); };
+		void OnPostGarbageCollect()
+		{
+			if (Phase == EPhase::Teardown && !bTeardownGcDone)
+			{
+				Result.TeardownGcMs = (FPlatformTime::Seconds() - GcStartTime) * 1000.0;
+				bTeardownGcDone = true;
+				return;
+			}
+			if (!bMeasuring)
+				return;
+			Result.GcMs += (FPlatformTime::Seconds() - GcStartTime) * 1000.0;
+			Result.NumGc++;
+		}
+
+		static FString GetScenarioName(EBehaviorBenchScenario Scenario)
+		{
+			return StaticEnum<EBehaviorBenchScenario>()->GetNameStringByValue((int64)Scenario);
+		}
+
+		TWeakObjectPtr<UWorld> World;
+		FBenchSettings Settings;
+		TArray<TPair<EBehaviorBenchScenario, int32>> Cases;
+		TArray<TWeakObjectPtr<ABehaviorOwner>> Agents;
+		TArray<FScenarioResult> Results;
+		FScenarioResult Result;
+		TArray<double> FrameTimes;
+
+		EPhase Phase = EPhase::Setup;
+		int32 CaseIndex = 0;
+		int32 Frame = 0;
+		double LastFrameTime = 0.0;
+		double GcStartTime = 0.0;
+		int64 StartAllocations = 0;
+		int64 StartAllocatedBytes = 0;
+		int64 NumObjectsCreated = 0;
+		bool bMeasuring = false;
+		bool bDone = false;
+		bool bTeardownGcDone = false;
+		bool bListening = true;
+
+		FDelegateHandle PreGcHandle, PostGcHandle;
+	};
+
+	static TUniquePtr<FBenchRunner> Runner;
+
+	// Behavior.Bench [Scenarios=Override,Queue,Base,Parallel,Chain] [Agents=10,100,1000,10000] [Frames=300] [Warmup=60] [FanOut=4] [Depth=16] [File=...] [Quit]
+	void Bench(const TArray<FString>& Args, UWorld* World)
+	{
+		if (Runner && !Runner->IsDone())
+		{
+			UE_LOG(LogBehavior, Warning, TEXT("Bench: already running."));
+			return;
+		}
+		Runner.Reset();
+
+		if (!World || !World->HasBegunPlay())
+		{
+			UE_LOG(LogBehavior, Error, TEXT("Bench: the world must be playing."));
+			return;
+		}
+
+		const FString Params = FString::Join(Args, TEXT(" "));
+		FBenchSettings Settings;
+
+		FString List;
+		TArray<FString> Items;
+		if (FParse::Value(*Params, TEXT("Scenarios="), List, false))
+			List.ParseIntoArray(Items, TEXT(","));
+		else Items = { TEXT("Override"), TEXT("Queue"), TEXT("Base"), TEXT("Parallel"), TEXT("Chain") };
+		for (const FString& Item : Items)
+		{
+			const int64 Value = StaticEnum<EBehaviorBenchScenario>()->GetValueByNameString(Item);
+			if (Value != INDEX_NONE)
+				Settings.Scenarios.Add((EBehaviorBenchScenario)Value);
+			else UE_LOG(LogBehavior, Warning, TEXT("Bench: unknown scenario %s."), *Item);
+		}
+
+		Items.Reset();
+		if (FParse::Value(*Params, TEXT("Agents="), List, false))
+			List.ParseIntoArray(Items, TEXT(","));
+		else Items = { TEXT("10"), TEXT("100"), TEXT("1000"), TEXT("10000") };
+		for (const FString& Item : Items)
+			Settings.Agents.Add(FMath::Max(FCString::Atoi(*Item), 1));
+
+		FParse::Value(*Params, TEXT("Frames="), Settings.Frames);
+		FParse::Value(*Params, TEXT("Warmup="), Settings.WarmupFrames);
+		FParse::Value(*Params, TEXT("FanOut="), Settings.FanOut);
+		FParse::Value(*Params, TEXT("Depth="), Settings.ChainDepth);
+		Settings.bQuit = Args.Contains(TEXT("Quit"));
+		if (!FParse::Value(*Params, TEXT("File="), Settings.Filename, false))
+			Settings.Filename = FPaths::ProfilingDir() / FString::Printf(TEXT("BehaviorBench-%s.json"), *FDateTime::Now().ToString());
+
+		if (Settings.Scenarios.Num() == 0 || Settings.Agents.Num() == 0)
+			return;
+
+		Runner = MakeUnique<FBenchRunner>(World, Settings);
+	}
+
+	static FAutoConsoleCommandWithWorldAndArgs BenchCommand(
+		TEXT("Behavior.Bench"),
+		TEXT("Run synthetic Behavior scenarios at several agent counts and save the results as JSON. Args: [Scenarios=Override,Queue,Base,Parallel,Chain] [Agents=10,100,1000,10000] [Frames=300] [Warmup=60] [FanOut=4] [Depth=16] [File=...] [Quit]"),
+		FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&Bench));
+}
@@ -0,0 +1,104 @@
+// (c) XenFFly
+
+#include "BenchmarkBehaviors.h"
+
+UBenchWait::UBenchWait(const FObjectInitializer& ObjectInitializer)
+	: Super(ObjectInitializer)
+{
+	m_fWaitTime = 0.05f;
+	PoolSize = 64;
+}
+
+UBenchUrgentWait::UBenchUrgentWait(const FObjectInitializer& ObjectInitializer)
+	: Super(ObjectInitializer)
+{
+	Priority = 0;
+	m_fWaitTime = 0.2f;
+}
+
+UBenchParallelWait::UBenchParallelWait(const FObjectInitializer& ObjectInitializer)
+	: Super(ObjectInitializer)
+{
+	Type = BT_Parallel;
+}
+
+UBenchBase::UBenchBase(const FObjectInitializer& ObjectInitializer)
+	: Super(ObjectInitializer)
+{
+	Type = BT_Base;
+	bTickOnDemand = true;
+
+	Behaviors.Add(FBehaviorData(UBenchWait::StaticClass(), 0, 4.f, 0.f, 2));
+	Behaviors.Add(FBehaviorData(UBenchWait::StaticClass(), 0, 2.f, 0.3f, 0));
+	Behaviors.Add(FBehaviorData(UBenchUrgentWait::StaticClass(), 0, 1.f, 1.f, 1));
+	Behaviors.Add(FBehaviorData(UBenchWait::StaticClass(), 3, 1.f, 0.5f, 0));
+}
+
+UBenchChain::UBenchChain(const FObjectInitializer& ObjectInitializer)
+	: Super(ObjectInitializer)
+{
+	bTickOnDemand = true;
+	PoolSize = 64;
+}
+
+void UBenchChain::Activate()
+{
+	Super::Activate();
+
+	if (ChainDepth > 1)
+	{
+		UBenchChain* Child = Cast<UBenchChain>(RunBehavior(UBenchChain::StaticClass(), false));
+		if (!Child)
+			return;
+		Child->ChainDepth = ChainDepth - 1;
+		Child->Ready();
+	}
+	else RunBehavior(UBenchWait::StaticClass());
+}
+
+void UBenchChain::OnChildBehaviorFinishedName_Implementation(TSubclassOf<UBehavior> Behavior, EBehaviorResult Result, FName FailedCode)
+{
+	if (IsBehaviorValid() && !bIsFinishing)
+		FinishBehavior(Result, FailedCode);
+}
+
+void UBenchDriver::Activate()
+{
+	Super::Activate();
+
+	// Don't step every agent in the same frame.
+	BehDelay(StepTimer, [this]() { Step(); }, FMath::FRandRange(KINDA_SMALL_NUMBER, StepInterval));
+}
+
+void UBenchDriver::Step()
+{
+	switch (Scenario)
+	{
+	case EBehaviorBenchScenario::Override:
+		RunBehavior(UBenchWait::StaticClass());
+		break;
+	case EBehaviorBenchScenario::Queue:
+		if (!GetChildBehavior())
+			RunBehavior(UBenchUrgentWait::StaticClass());
+		RunBehavior(UBenchWait::StaticClass());
+		break;
+	case EBehaviorBenchScenario::Parallel:
+		for (int32 i = 0; i < FanOut; i++)
+			RunBehavior(UBenchParallelWait::StaticClass());
+		break;
+	case EBehaviorBenchScenario::Chain:
+		if (!GetChildBehavior())
+		{
+			if (UBenchChain* Chain = Cast<UBenchChain>(RunBehavior(UBenchChain::StaticClass(), false)))
+			{
+				Chain->ChainDepth = ChainDepth;
+				Chain->Ready();
+			}
+		}
+		break;
+	default:
+		break;
+	}
+
+	BehDelay(StepTimer, [this]() { Step(); }, StepInterval);
+}
@@ -0,0 +1,98 @@
+// (c) XenFFly
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Behavior/Base/BehWait.h"
+#include "BenchmarkBehaviors.generated.h"
+
+// Synthetic Behavior graphs used by Behavior.Bench.
+UENUM()
+enum class EBehaviorBenchScenario : uint8
+{
+	Override,	// Equal priority RunBehavior finishes the running child
+	Queue,		// Lower priority RunBehavior waits in TaskQueue
+	Base,		// BT_Base selection with cooldowns and repeats
+	Parallel,	// BT_Parallel fan-out
+	Chain		// Deep Default chain finished from the leaf
+};
+
+// Short wait, the leaf of every scenario.
+UCLASS(NotBlueprintable, HideDropdown)
+class SHATALOVBEHAVIORBENCH_API UBenchWait : public UBehWait
+{
+	GENERATED_BODY()
+
+public:
+	UBenchWait(const FObjectInitializer& ObjectInitializer);
+};
+
+UCLASS(NotBlueprintable, HideDropdown)
+class SHATALOVBEHAVIORBENCH_API UBenchUrgentWait : public UBenchWait
+{
+	GENERATED_BODY()
+
+public:
+	UBenchUrgentWait(const FObjectInitializer& ObjectInitializer);
+};
+
+UCLASS(NotBlueprintable, HideDropdown)
+class SHATALOVBEHAVIORBENCH_API UBenchParallelWait : public UBenchWait
+{
+	GENERATED_BODY()
+
+public:
+	UBenchParallelWait(const FObjectInitializer& ObjectInitializer);
+};
+
+UCLASS(NotBlueprintable, HideDropdown)
+class SHATALOVBEHAVIORBENCH_API UBenchBase : public UBehavior
+{
+	GENERATED_BODY()
+
+public:
+	UBenchBase(const FObjectInitializer& ObjectInitializer);
+};
+
+// Runs itself until ChainDepth, then UBenchWait. Finishes with its child.
+UCLASS(NotBlueprintable, HideDropdown)
+class SHATALOVBEHAVIORBENCH_API UBenchChain : public UBehavior
+{
+	GENERATED_BODY()
+
+public:
+	UBenchChain(const FObjectInitializer& ObjectInitializer);
+
+	virtual void Activate() override;
+	virtual void OnChildBehaviorFinishedName_Implementation(TSubclassOf<UBehavior> Behavior, EBehaviorResult Result, FName FailedCode) override;
+
+	UPROPERTY()
+	int32 ChainDepth = 1;
+};
+
+// Runs a scenario every StepInterval.
+UCLASS(NotBlueprintable, HideDropdown)
+class SHATALOVBEHAVIORBENCH_API UBenchDriver : public UBehavior
+{
+	GENERATED_BODY()
+
+public:
+	virtual void Activate() override;
+
+	UPROPERTY()
+	EBehaviorBenchScenario Scenario = EBehaviorBenchScenario::Override;
+
+	UPROPERTY()
+	float StepInterval = 0.1f;
+
+	UPROPERTY()
+	int32 FanOut = 4;
+
+	UPROPERTY()
+	int32 ChainDepth = 16;
+
+private:
+	void Step();
+
+	FTimerHandle StepTimer;
+};
@@ -0,0 +1,14 @@
+// (c) XenFFly
+
+using UnrealBuildTool;
+
+// Behavior.Bench* console commands and their synthetic Behaviors. DeveloperTool, so shipping builds don't contain them.
+public class ShatalovBehaviorBench : ModuleRules
+{
+	public ShatalovBehaviorBench(ReadOnlyTargetRules Target) : base(Target)
+	{
+		PCHUsage = PCHUsageMode.UseExplicitOrSharedPCHs;
+
+		PrivateDependencyModuleNames.AddRange(new string[] { "Core", "CoreUObject", "Engine", "GameplayTasks", "AIModule", "ShatalovBehavior" });
+	}
+}
@@ -0,0 +1,5 @@
+// (c) XenFFly
+
+#include "Modules/ModuleManager.h"
+
+IMPLEMENT_MODULE(FDefaultModuleImpl, ShatalovBehaviorBench);